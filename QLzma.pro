@@ -1,9 +1,17 @@
 TEMPLATE = subdirs
 CONFIG += ordered
-SUBDIRS = lzma qlzma
+SUBDIRS = lzma qlzma cli bench lzma2stats deckernel
 
 qlzma.file = src/qlzma.pro
 qlzma.depends += lzma
+cli.file = src/cli/cli.pro
+cli.depends += lzma
+bench.file = src/bench/bench.pro
+bench.depends += lzma
+#test: exits 1 if the lzma2 encoder stats miss some blocks
+lzma2stats.file = tests/lzma2stats/lzma2stats.pro
+#test: exits 1 if the fast decoder kernel differs from the reference one
+deckernel.file = tests/deckernel/deckernel.pro
 
 
 OTHER_FILES += \
@@ -5,6 +5,8 @@ Public domain */
 
 #ifdef _WIN32
 #include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
 #endif
 #include <stdlib.h>
 
@@ -125,3 +127,86 @@ void BigFree(void *address)
 }
 
 #endif
+
+#ifdef __linux__
+
+/* BigAlloc keeps the mapping size in front of the block (0: malloc).
+   64 bytes keep the block aligned to the cache line */
+#define kBigHeaderSize 64
+#define kHugePageSize ((size_t)1 << 21)
+
+static int g_LargePages = 0;
+
+void SetLargePageSize()
+{
+  g_LargePages = 1;
+}
+
+void *BigAlloc(size_t size)
+{
+  unsigned char *p = (unsigned char *)MAP_FAILED;
+  size_t mapSize;
+  if (size == 0)
+    return 0;
+  #ifdef _SZ_ALLOC_DEBUG
+  fprintf(stderr, "\nAlloc_Big %10d bytes;  count = %10d", size, g_allocCountBig++);
+  #endif
+
+  if (size < kHugePageSize - kBigHeaderSize)
+  {
+    p = (unsigned char *)malloc(kBigHeaderSize + size);
+    if (p == 0)
+      return 0;
+    *(size_t *)p = 0;
+    return p + kBigHeaderSize;
+  }
+  if (size > ((size_t)0 - 2 * kHugePageSize - kBigHeaderSize))
+    return 0;
+  mapSize = (kBigHeaderSize + size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+
+  #ifdef MAP_HUGETLB
+  if (g_LargePages)
+    p = (unsigned char *)mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  #endif
+  if (p == (unsigned char *)MAP_FAILED)
+  {
+    /* transparent huge pages only back the 2 MB aligned parts of a mapping:
+       map one huge page more and unmap the unaligned head and tail */
+    unsigned char *base = (unsigned char *)mmap(0, mapSize + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    size_t head;
+    if (base == (unsigned char *)MAP_FAILED)
+      return 0;
+    head = (kHugePageSize - ((size_t)base & (kHugePageSize - 1))) & (kHugePageSize - 1);
+    p = base + head;
+    if (head != 0)
+      munmap(base, head);
+    if (head != kHugePageSize)
+      munmap(p + mapSize, kHugePageSize - head);
+    #ifdef MADV_HUGEPAGE
+    madvise(p, mapSize, MADV_HUGEPAGE);
+    #endif
+  }
+  *(size_t *)p = mapSize;
+  return p + kBigHeaderSize;
+}
+
+void BigFree(void *address)
+{
+  unsigned char *p;
+  size_t mapSize;
+  #ifdef _SZ_ALLOC_DEBUG
+  if (address != 0)
+    fprintf(stderr, "\nFree_Big; count = %10d", --g_allocCountBig);
+  #endif
+
+  if (address == 0)
+    return;
+  p = (unsigned char *)address - kBigHeaderSize;
+  mapSize = *(size_t *)p;
+  if (mapSize == 0)
+    free(p);
+  else
+    munmap(p, mapSize);
+}
+
+#endif
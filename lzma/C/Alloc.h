@@ -22,6 +22,17 @@ void MidFree(void *address);
 void *BigAlloc(size_t size);
 void BigFree(void *address);
 
+#elif defined(__linux__)
+
+/* BigAlloc maps the big blocks on 2 MB boundaries and asks for transparent huge pages.
+   After SetLargePageSize() it tries MAP_HUGETLB first (needs vm.nr_hugepages) */
+void SetLargePageSize();
+
+#define MidAlloc(size) MyAlloc(size)
+#define MidFree(address) MyFree(address)
+void *BigAlloc(size_t size);
+void BigFree(void *address);
+
 #else
 
 #define MidAlloc(size) MyAlloc(size)
@@ -0,0 +1,110 @@
+/* CpuArch.c -- CPU specific code
+2011-07-04 : Public domain */
+
+#include "CpuArch.h"
+
+#ifdef MY_CPU_X86_OR_AMD64
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+static void MyCPUID(UInt32 function, UInt32 subFunction, UInt32 *a, UInt32 *b, UInt32 *c, UInt32 *d)
+{
+  #if defined(_MSC_VER) && _MSC_VER >= 1500
+  int regs[4];
+  __cpuidex(regs, (int)function, (int)subFunction);
+  *a = (UInt32)regs[0];
+  *b = (UInt32)regs[1];
+  *c = (UInt32)regs[2];
+  *d = (UInt32)regs[3];
+  #elif defined(__GNUC__)
+  unsigned int ra, rb, rc, rd;
+  __cpuid_count(function, subFunction, ra, rb, rc, rd);
+  *a = ra;
+  *b = rb;
+  *c = rc;
+  *d = rd;
+  #else
+  function = function;
+  subFunction = subFunction;
+  *a = *b = *c = *d = 0;
+  #endif
+}
+
+/* XCR0: the OS saves the xmm (bit 1) and ymm (bit 2) registers */
+static UInt32 MyXGETBV(void)
+{
+  #if defined(_MSC_VER) && _MSC_VER >= 1600
+  return (UInt32)_xgetbv(0);
+  #elif defined(__GNUC__)
+  UInt32 a, d;
+  __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (a), "=d" (d) : "c" (0));
+  return a;
+  #else
+  return 0;
+  #endif
+}
+
+Bool x86cpuid_CheckAndRead(Cx86cpuid *p)
+{
+  #ifdef MY_CPU_X86
+  /* 80386 and early 80486 have no CPUID: the ID bit (21) of EFLAGS can not be changed */
+  #if defined(__GNUC__)
+  UInt32 before, after;
+  __asm__ __volatile__ (
+    "pushfl\n\t"
+    "pushfl\n\t"
+    "popl %0\n\t"
+    "movl %0, %1\n\t"
+    "xorl $0x200000, %0\n\t"
+    "pushl %0\n\t"
+    "popfl\n\t"
+    "pushfl\n\t"
+    "popl %0\n\t"
+    "popfl\n\t"
+    : "=&r" (after), "=&r" (before));
+  if (((before ^ after) & 0x200000) == 0)
+    return False;
+  #endif
+  #endif
+  MyCPUID(0, 0, &p->maxFunc, &p->vendor[0], &p->vendor[2], &p->vendor[1]);
+  if (p->maxFunc < 1)
+    return False;
+  MyCPUID(1, 0, &p->ver, &p->b, &p->c, &p->d);
+  return True;
+}
+
+Bool CPU_Is_Sse2_Supported(void)
+{
+  #ifdef MY_CPU_AMD64
+  return True;
+  #else
+  Cx86cpuid p;
+  if (!x86cpuid_CheckAndRead(&p))
+    return False;
+  return (p.d >> 26) & 1;
+  #endif
+}
+
+Bool CPU_Is_Avx2_Supported(void)
+{
+  Cx86cpuid p;
+  UInt32 a, b, c, d;
+  if (!x86cpuid_CheckAndRead(&p) || p.maxFunc < 7)
+    return False;
+  /* AVX (bit 28) and OSXSAVE (bit 27), then the OS must save the ymm registers */
+  if (((p.c >> 27) & 3) != 3 || (MyXGETBV() & 6) != 6)
+    return False;
+  MyCPUID(7, 0, &a, &b, &c, &d);
+  return (b >> 5) & 1;
+}
+
+#else
+
+Bool CPU_Is_Sse2_Supported(void) { return False; }
+Bool CPU_Is_Avx2_Supported(void) { return False; }
+
+#endif
@@ -0,0 +1,65 @@
+/* CpuArch.h -- CPU specific code
+2011-07-04 : Public domain */
+
+#ifndef __CPU_ARCH_H
+#define __CPU_ARCH_H
+
+#include "Types.h"
+
+EXTERN_C_BEGIN
+
+/*
+MY_CPU_LE means that CPU is LITTLE ENDIAN.
+If MY_CPU_LE is not defined, we don't know about that property of platform (it can be LITTLE ENDIAN).
+
+MY_CPU_LE_UNALIGN means that CPU is LITTLE ENDIAN and CPU supports unaligned memory accesses.
+If MY_CPU_LE_UNALIGN is not defined, we don't know about these properties of platform.
+*/
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__)
+#define MY_CPU_AMD64
+#endif
+
+#if defined(MY_CPU_AMD64) || defined(_M_IA64) || defined(__aarch64__)
+#define MY_CPU_64BIT
+#endif
+
+#if defined(_M_IX86) || defined(__i386__)
+#define MY_CPU_X86
+#endif
+
+#if defined(MY_CPU_X86) || defined(MY_CPU_AMD64)
+#define MY_CPU_X86_OR_AMD64
+#endif
+
+#if defined(MY_CPU_X86_OR_AMD64) || defined(_M_ARM) || defined(__ARMEL__) || defined(__AARCH64EL__)
+#define MY_CPU_LE
+#endif
+
+#if defined(MY_CPU_X86_OR_AMD64) || defined(__AARCH64EL__)
+#define MY_CPU_LE_UNALIGN
+#endif
+
+#ifdef MY_CPU_X86_OR_AMD64
+
+typedef struct
+{
+  UInt32 maxFunc;
+  UInt32 vendor[3];
+  UInt32 ver;
+  UInt32 b;
+  UInt32 c;
+  UInt32 d;
+} Cx86cpuid;
+
+Bool x86cpuid_CheckAndRead(Cx86cpuid *p);
+
+#endif
+
+/* False if the CPU or the OS (saving the ymm registers) lacks it, or if it is not x86 */
+Bool CPU_Is_Sse2_Supported(void);
+Bool CPU_Is_Avx2_Supported(void);
+
+EXTERN_C_END
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <string.h>
 
+#include "CpuArch.h"
 #include "LzFind.h"
 #include "LzHash.h"
 
@@ -130,12 +131,135 @@ static void MatchFinder_SetDefaultSettings(CMatchFinder *p)
 
 #define kCrcPoly 0xEDB88320
 
+/* ---------- match length ---------- */
+
+/* The MatchLen_* functions return the first i in [len, lenLimit) with pb[i] != cur[i], or lenLimit (or len if len >= lenLimit).
+   They never read at or above lenLimit: with directInput the window can end right there. */
+
+typedef UInt32 (*Mf_MatchLen_Func)(const Byte *pb, const Byte *cur, UInt32 len, UInt32 lenLimit);
+
+static UInt32 MatchLen_Byte(const Byte *pb, const Byte *cur, UInt32 len, UInt32 lenLimit)
+{
+  for (; len < lenLimit; len++)
+    if (pb[len] != cur[len])
+      break;
+  return len;
+}
+
+#if defined(__GNUC__)
+#define MY_CTZ32(x) ((UInt32)__builtin_ctz(x))
+#elif defined(_MSC_VER)
+#include <intrin.h>
+static UInt32 MY_CTZ32(UInt32 x) { unsigned long i; _BitScanForward(&i, x); return (UInt32)i; }
+#endif
+
+#if defined(MY_CPU_LE_UNALIGN) && defined(MY_CPU_64BIT) && (defined(__GNUC__) || (defined(_MSC_VER) && defined(MY_CPU_AMD64)))
+
+#define MATCH_LEN_64
+
+#if defined(__GNUC__)
+#define MY_CTZ64(x) ((UInt32)__builtin_ctzll(x))
+#else
+static UInt32 MY_CTZ64(UInt64 x) { unsigned long i; _BitScanForward64(&i, x); return (UInt32)i; }
+#endif
+
+/* 8 bytes at a time: the lowest set bit of the XOR is the first different byte (little endian) */
+static UInt32 MatchLen_64(const Byte *pb, const Byte *cur, UInt32 len, UInt32 lenLimit)
+{
+  while (len + 8 <= lenLimit)
+  {
+    UInt64 a, b;
+    memcpy(&a, pb + len, 8);
+    memcpy(&b, cur + len, 8);
+    if (a != b)
+      return len + (MY_CTZ64(a ^ b) >> 3);
+    len += 8;
+  }
+  return MatchLen_Byte(pb, cur, len, lenLimit);
+}
+
+#endif
+
+/* SSE2 and AVX2 are compiled for their own functions only (no -msse2/-mavx2 needed),
+   they are called only if CPU_Is_*_Supported() */
+#if defined(MY_CPU_X86_OR_AMD64) && (defined(_MSC_VER) && _MSC_VER >= 1700 || \
+    defined(__clang__) || defined(__GNUC__) && (__GNUC__ > 4 || __GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+
+#define MATCH_LEN_SIMD
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define MY_TARGET(isa)
+#else
+#define MY_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#define MATCH_LEN_SSE2_STEP \
+  { UInt32 mask = (UInt32)_mm_movemask_epi8(_mm_cmpeq_epi8( \
+      _mm_loadu_si128((const __m128i *)(pb + len)), _mm_loadu_si128((const __m128i *)(cur + len)))) ^ 0xFFFF; \
+    if (mask != 0) \
+      return len + MY_CTZ32(mask); \
+    len += 16; }
+
+static MY_TARGET("sse2") UInt32 MatchLen_Sse2(const Byte *pb, const Byte *cur, UInt32 len, UInt32 lenLimit)
+{
+  while (len + 16 <= lenLimit)
+    MATCH_LEN_SSE2_STEP
+  return MatchLen_Byte(pb, cur, len, lenLimit);
+}
+
+static MY_TARGET("avx2") UInt32 MatchLen_Avx2(const Byte *pb, const Byte *cur, UInt32 len, UInt32 lenLimit)
+{
+  while (len + 32 <= lenLimit)
+  {
+    UInt32 mask = ~(UInt32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_loadu_si256((const __m256i *)(pb + len)), _mm256_loadu_si256((const __m256i *)(cur + len))));
+    if (mask != 0)
+      return len + MY_CTZ32(mask);
+    len += 32;
+  }
+  if (len + 16 <= lenLimit)
+    MATCH_LEN_SSE2_STEP
+  return MatchLen_Byte(pb, cur, len, lenLimit);
+}
+
+#endif
+
+static Mf_MatchLen_Func g_MatchLen = MatchLen_Byte;
+static int g_MatchLenSelected = 0;
+
+/* the widest compare the CPU has, chosen once (MatchFinder_Construct) */
+static void MatchLen_Select(void)
+{
+  Mf_MatchLen_Func f = MatchLen_Byte;
+  if (g_MatchLenSelected)
+    return;
+  #ifdef MATCH_LEN_64
+  f = MatchLen_64;
+  #endif
+  #ifdef MATCH_LEN_SIMD
+  if (CPU_Is_Avx2_Supported())
+    f = MatchLen_Avx2;
+  else if (CPU_Is_Sse2_Supported())
+    f = MatchLen_Sse2;
+  #endif
+  g_MatchLen = f;
+  g_MatchLenSelected = 1;
+}
+
+UInt32 MatchFinder_GetMatchLen(const Byte *pb, const Byte *cur, UInt32 len, UInt32 lenLimit)
+{
+  return g_MatchLen(pb, cur, len, lenLimit);
+}
+
 void MatchFinder_Construct(CMatchFinder *p)
 {
   UInt32 i;
+  MatchLen_Select();
   p->bufferBase = 0;
   p->directInput = 0;
   p->hash = 0;
+  p->hashIsValid = 0;
   MatchFinder_SetDefaultSettings(p);
 
   for (i = 0; i < 256; i++)
@@ -152,6 +276,7 @@ static void MatchFinder_FreeThisClassMemory(CMatchFinder *p, ISzAlloc *alloc)
 {
   alloc->Free(alloc, p->hash);
   p->hash = 0;
+  p->hashIsValid = 0;
 }
 
 void MatchFinder_Free(CMatchFinder *p, ISzAlloc *alloc)
@@ -168,6 +293,61 @@ static CLzRef* AllocRefs(UInt32 num, ISzAlloc *alloc)
   return (CLzRef *)alloc->Alloc(alloc, sizeInBytes);
 }
 
+static UInt32 MatchFinder_GetSizeReserv(UInt32 historySize,
+    UInt32 keepAddBufferBefore, UInt32 matchMaxLen, UInt32 keepAddBufferAfter)
+{
+  UInt32 sizeReserv = historySize >> 1;
+  if (historySize > ((UInt32)2 << 30))
+    sizeReserv = historySize >> 2;
+  sizeReserv += (keepAddBufferBefore + matchMaxLen + keepAddBufferAfter) / 2 + (1 << 19);
+  return sizeReserv;
+}
+
+/* returns hashMask; *fixedHashSize: the 2/3 byte hash tables in front of the main one (none for btMode 2) */
+static UInt32 MatchFinder_GetHashMask(int btMode, UInt32 numHashBytes, UInt32 historySize, UInt32 *fixedHashSize)
+{
+  UInt32 hs;
+  *fixedHashSize = 0;
+  if (numHashBytes == 2)
+    hs = (1 << 16) - 1;
+  else
+  {
+    hs = historySize - 1;
+    hs |= (hs >> 1);
+    hs |= (hs >> 2);
+    hs |= (hs >> 4);
+    hs |= (hs >> 8);
+    hs >>= 1;
+    hs |= 0xFFFF; /* don't change it! It's required for Deflate */
+    if (hs > (1 << 24))
+    {
+      if (numHashBytes == 3)
+        hs = (1 << 24) - 1;
+      else
+        hs >>= 1;
+    }
+  }
+  if (btMode == 2) return hs;
+  if (numHashBytes > 2) *fixedHashSize += kHash2Size;
+  if (numHashBytes > 3) *fixedHashSize += kHash3Size;
+  if (numHashBytes > 4) *fixedHashSize += kHash4Size;
+  return hs;
+}
+
+UInt64 MatchFinder_GetMemUsage(UInt32 historySize,
+    UInt32 keepAddBufferBefore, UInt32 matchMaxLen, UInt32 keepAddBufferAfter,
+    int btMode, UInt32 numHashBytes, int directInput)
+{
+  UInt32 fixedHashSize;
+  UInt32 hs = MatchFinder_GetHashMask(btMode, numHashBytes, historySize, &fixedHashSize) + 1 + fixedHashSize;
+  UInt64 numSons = (btMode == 2 ? 0 : (UInt64)(historySize + 1) * (btMode ? 2 : 1));
+  UInt64 size = ((UInt64)hs + numSons) * sizeof(CLzRef);
+  if (!directInput)
+    size += (UInt64)(historySize + keepAddBufferBefore + 1) + (matchMaxLen + keepAddBufferAfter) +
+        MatchFinder_GetSizeReserv(historySize, keepAddBufferBefore, matchMaxLen, keepAddBufferAfter);
+  return size;
+}
+
 int MatchFinder_Create(CMatchFinder *p, UInt32 historySize,
     UInt32 keepAddBufferBefore, UInt32 matchMaxLen, UInt32 keepAddBufferAfter,
     ISzAlloc *alloc)
@@ -178,10 +358,7 @@ int MatchFinder_Create(CMatchFinder *p, UInt32 historySize,
     MatchFinder_Free(p, alloc);
     return 0;
   }
-  sizeReserv = historySize >> 1;
-  if (historySize > ((UInt32)2 << 30))
-    sizeReserv = historySize >> 2;
-  sizeReserv += (keepAddBufferBefore + matchMaxLen + keepAddBufferAfter) / 2 + (1 << 19);
+  sizeReserv = MatchFinder_GetSizeReserv(historySize, keepAddBufferBefore, matchMaxLen, keepAddBufferAfter);
 
   p->keepSizeBefore = historySize + keepAddBufferBefore + 1;
   p->keepSizeAfter = matchMaxLen + keepAddBufferAfter;
@@ -191,34 +368,9 @@ int MatchFinder_Create(CMatchFinder *p, UInt32 historySize,
     UInt32 newCyclicBufferSize = historySize + 1;
     UInt32 hs;
     p->matchMaxLen = matchMaxLen;
-    {
-      p->fixedHashSize = 0;
-      if (p->numHashBytes == 2)
-        hs = (1 << 16) - 1;
-      else
-      {
-        hs = historySize - 1;
-        hs |= (hs >> 1);
-        hs |= (hs >> 2);
-        hs |= (hs >> 4);
-        hs |= (hs >> 8);
-        hs >>= 1;
-        hs |= 0xFFFF; /* don't change it! It's required for Deflate */
-        if (hs > (1 << 24))
-        {
-          if (p->numHashBytes == 3)
-            hs = (1 << 24) - 1;
-          else
-            hs >>= 1;
-        }
-      }
-      p->hashMask = hs;
-      hs++;
-      if (p->numHashBytes > 2) p->fixedHashSize += kHash2Size;
-      if (p->numHashBytes > 3) p->fixedHashSize += kHash3Size;
-      if (p->numHashBytes > 4) p->fixedHashSize += kHash4Size;
-      hs += p->fixedHashSize;
-    }
+    p->hashMask = hs = MatchFinder_GetHashMask(p->btMode, p->numHashBytes, historySize, &p->fixedHashSize);
+    hs++;
+    hs += p->fixedHashSize;
 
     {
       UInt32 prevSize = p->hashSizeSum + p->numSons;
@@ -226,7 +378,7 @@ int MatchFinder_Create(CMatchFinder *p, UInt32 historySize,
       p->historySize = historySize;
       p->hashSizeSum = hs;
       p->cyclicBufferSize = newCyclicBufferSize;
-      p->numSons = (p->btMode ? newCyclicBufferSize * 2 : newCyclicBufferSize);
+      p->numSons = (p->btMode == 2 ? 0 : (p->btMode ? newCyclicBufferSize * 2 : newCyclicBufferSize));
       newSize = p->hashSizeSum + p->numSons;
       if (p->hash != 0 && prevSize == newSize)
         return 1;
@@ -268,14 +420,27 @@ static void MatchFinder_SetLimits(CMatchFinder *p)
   p->posLimit = p->pos + limit;
 }
 
+/* kEmptyHashValue entries and positions of a previous stream are all rejected
+   by (pos - curMatch >= cyclicBufferSize). So if the match finder is reused,
+   the new stream can start cyclicBufferSize after the old positions instead of
+   clearing the hash: that is what makes reusing an encoder with a big dictionary cheap. */
+#define kMaxReusedPos ((UInt32)1 << 31)
+
 void MatchFinder_Init(CMatchFinder *p)
 {
-  UInt32 i;
-  for (i = 0; i < p->hashSizeSum; i++)
-    p->hash[i] = kEmptyHashValue;
+  if (p->hashIsValid && p->pos < kMaxReusedPos - p->cyclicBufferSize)
+    p->pos += p->cyclicBufferSize;
+  else
+  {
+    UInt32 i;
+    for (i = 0; i < p->hashSizeSum; i++)
+      p->hash[i] = kEmptyHashValue;
+    p->pos = p->cyclicBufferSize;
+    p->hashIsValid = 1;
+  }
   p->cyclicBufferPos = 0;
   p->buffer = p->bufferBase;
-  p->pos = p->streamPos = p->cyclicBufferSize;
+  p->streamPos = p->pos;
   p->result = SZ_OK;
   p->streamEndWasReached = 0;
   MatchFinder_ReadBlock(p);
@@ -319,25 +484,35 @@ static void MatchFinder_CheckLimits(CMatchFinder *p)
   MatchFinder_SetLimits(p);
 }
 
+#ifdef LZMA_ENC_STATS
+/* cutValue wrapped around: the chain was cut */
+#define MF_STATS_STOP if (cutValue == (UInt32)0 - 1) stats->numChainCuts++;
+#define MF_STATS_STEP stats->numChainSteps++;
+#else
+#define MF_STATS_STOP
+#define MF_STATS_STEP
+#endif
+
 static UInt32 * Hc_GetMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *cur, CLzRef *son,
     UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 cutValue,
-    UInt32 *distances, UInt32 maxLen)
+    UInt32 *distances, UInt32 maxLen MF_STATS_PARAM)
 {
   son[_cyclicBufferPos] = curMatch;
   for (;;)
   {
     UInt32 delta = pos - curMatch;
     if (cutValue-- == 0 || delta >= _cyclicBufferSize)
+    {
+      MF_STATS_STOP
       return distances;
+    }
+    MF_STATS_STEP
     {
       const Byte *pb = cur - delta;
       curMatch = son[_cyclicBufferPos - delta + ((delta > _cyclicBufferPos) ? _cyclicBufferSize : 0)];
       if (pb[maxLen] == cur[maxLen] && *pb == *cur)
       {
-        UInt32 len = 0;
-        while (++len != lenLimit)
-          if (pb[len] != cur[len])
-            break;
+        UInt32 len = g_MatchLen(pb, cur, 1, lenLimit);
         if (maxLen < len)
         {
           *distances++ = maxLen = len;
@@ -352,7 +527,7 @@ static UInt32 * Hc_GetMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos,
 
 UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *cur, CLzRef *son,
     UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 cutValue,
-    UInt32 *distances, UInt32 maxLen)
+    UInt32 *distances, UInt32 maxLen MF_STATS_PARAM)
 {
   CLzRef *ptr0 = son + (_cyclicBufferPos << 1) + 1;
   CLzRef *ptr1 = son + (_cyclicBufferPos << 1);
@@ -362,9 +537,11 @@ UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byt
     UInt32 delta = pos - curMatch;
     if (cutValue-- == 0 || delta >= _cyclicBufferSize)
     {
+      MF_STATS_STOP
       *ptr0 = *ptr1 = kEmptyHashValue;
       return distances;
     }
+    MF_STATS_STEP
     {
       CLzRef *pair = son + ((_cyclicBufferPos - delta + ((delta > _cyclicBufferPos) ? _cyclicBufferSize : 0)) << 1);
       const Byte *pb = cur - delta;
@@ -372,9 +549,7 @@ UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byt
       if (pb[len] == cur[len])
       {
         if (++len != lenLimit && pb[len] == cur[len])
-          while (++len != lenLimit)
-            if (pb[len] != cur[len])
-              break;
+          len = g_MatchLen(pb, cur, len + 1, lenLimit);
         if (maxLen < len)
         {
           *distances++ = maxLen = len;
@@ -406,7 +581,7 @@ UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byt
 }
 
 static void SkipMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *cur, CLzRef *son,
-    UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 cutValue)
+    UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 cutValue MF_STATS_PARAM)
 {
   CLzRef *ptr0 = son + (_cyclicBufferPos << 1) + 1;
   CLzRef *ptr1 = son + (_cyclicBufferPos << 1);
@@ -416,18 +591,19 @@ static void SkipMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const
     UInt32 delta = pos - curMatch;
     if (cutValue-- == 0 || delta >= _cyclicBufferSize)
     {
+      MF_STATS_STOP
       *ptr0 = *ptr1 = kEmptyHashValue;
       return;
     }
+    MF_STATS_STEP
     {
       CLzRef *pair = son + ((_cyclicBufferPos - delta + ((delta > _cyclicBufferPos) ? _cyclicBufferSize : 0)) << 1);
       const Byte *pb = cur - delta;
       UInt32 len = (len0 < len1 ? len0 : len1);
       if (pb[len] == cur[len])
       {
-        while (++len != lenLimit)
-          if (pb[len] != cur[len])
-            break;
+        if (++len != lenLimit && pb[len] == cur[len])
+          len = g_MatchLen(pb, cur, len + 1, lenLimit);
         {
           if (len == lenLimit)
           {
@@ -476,10 +652,10 @@ static void MatchFinder_MovePos(CMatchFinder *p) { MOVE_POS; }
 
 #define GET_MATCHES_FOOTER(offset, maxLen) \
   offset = (UInt32)(GetMatchesSpec1(lenLimit, curMatch, MF_PARAMS(p), \
-  distances + offset, maxLen) - distances); MOVE_POS_RET;
+  distances + offset, maxLen MF_STATS_ARG(&p->stats)) - distances); MOVE_POS_RET;
 
 #define SKIP_FOOTER \
-  SkipMatchesSpec(lenLimit, curMatch, MF_PARAMS(p)); MOVE_POS;
+  SkipMatchesSpec(lenLimit, curMatch, MF_PARAMS(p) MF_STATS_ARG(&p->stats)); MOVE_POS;
 
 static UInt32 Bt2_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances)
 {
@@ -529,7 +705,7 @@ static UInt32 Bt3_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances)
     offset = 2;
     if (maxLen == lenLimit)
     {
-      SkipMatchesSpec(lenLimit, curMatch, MF_PARAMS(p));
+      SkipMatchesSpec(lenLimit, curMatch, MF_PARAMS(p) MF_STATS_ARG(&p->stats));
       MOVE_POS_RET;
     }
   }
@@ -574,7 +750,7 @@ static UInt32 Bt4_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances)
     distances[offset - 2] = maxLen;
     if (maxLen == lenLimit)
     {
-      SkipMatchesSpec(lenLimit, curMatch, MF_PARAMS(p));
+      SkipMatchesSpec(lenLimit, curMatch, MF_PARAMS(p) MF_STATS_ARG(&p->stats));
       MOVE_POS_RET;
     }
   }
@@ -628,7 +804,37 @@ static UInt32 Hc4_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances)
   if (maxLen < 3)
     maxLen = 3;
   offset = (UInt32)(Hc_GetMatchesSpec(lenLimit, curMatch, MF_PARAMS(p),
-    distances + offset, maxLen) - (distances));
+    distances + offset, maxLen MF_STATS_ARG(&p->stats)) - (distances));
+  MOVE_POS_RET
+}
+
+/* btMode 2: one position per hash value and no chain, the LZ4 way. The only candidate is
+   the last position with the same hash, returned if its first 4 bytes are the same */
+static UInt32 Hs4_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances)
+{
+  UInt32 offset, delta;
+  GET_MATCHES_HEADER(4)
+
+  HASH4_SINGLE_CALC;
+
+  curMatch = p->hash[hashValue];
+  p->hash[hashValue] = p->pos;
+
+  offset = 0;
+  delta = p->pos - curMatch;
+  if (delta < p->cyclicBufferSize)
+  {
+    UInt32 len = g_MatchLen(cur - delta, cur, 0, lenLimit);
+    if (len >= 4)
+    {
+      distances[0] = len;
+      distances[1] = delta - 1;
+      offset = 2;
+    }
+    #ifdef LZMA_ENC_STATS
+    p->stats.numChainSteps++;
+    #endif
+  }
   MOVE_POS_RET
 }
 
@@ -640,7 +846,7 @@ UInt32 Hc3Zip_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances)
   curMatch = p->hash[hashValue];
   p->hash[hashValue] = p->pos;
   offset = (UInt32)(Hc_GetMatchesSpec(lenLimit, curMatch, MF_PARAMS(p),
-    distances, 2) - (distances));
+    distances, 2 MF_STATS_ARG(&p->stats)) - (distances));
   MOVE_POS_RET
 }
 
@@ -718,6 +924,25 @@ static void Hc4_MatchFinder_Skip(CMatchFinder *p, UInt32 num)
   while (--num != 0);
 }
 
+static void Hs4_MatchFinder_Skip(CMatchFinder *p, UInt32 num)
+{
+  do
+  {
+    UInt32 hashValue;
+    const Byte *cur;
+    if (p->lenLimit < 4)
+    {
+      MatchFinder_MovePos(p);
+      continue;
+    }
+    cur = p->buffer;
+    HASH4_SINGLE_CALC;
+    p->hash[hashValue] = p->pos;
+    MOVE_POS
+  }
+  while (--num != 0);
+}
+
 void Hc3Zip_MatchFinder_Skip(CMatchFinder *p, UInt32 num)
 {
   do
@@ -738,7 +963,12 @@ void MatchFinder_CreateVTable(CMatchFinder *p, IMatchFinder *vTable)
   vTable->GetIndexByte = (Mf_GetIndexByte_Func)MatchFinder_GetIndexByte;
   vTable->GetNumAvailableBytes = (Mf_GetNumAvailableBytes_Func)MatchFinder_GetNumAvailableBytes;
   vTable->GetPointerToCurrentPos = (Mf_GetPointerToCurrentPos_Func)MatchFinder_GetPointerToCurrentPos;
-  if (!p->btMode)
+  if (p->btMode == 2)
+  {
+    vTable->GetMatches = (Mf_GetMatches_Func)Hs4_MatchFinder_GetMatches;
+    vTable->Skip = (Mf_Skip_Func)Hs4_MatchFinder_Skip;
+  }
+  else if (!p->btMode)
   {
     vTable->GetMatches = (Mf_GetMatches_Func)Hc4_MatchFinder_GetMatches;
     vTable->Skip = (Mf_Skip_Func)Hc4_MatchFinder_Skip;
@@ -12,6 +12,20 @@ extern "C" {
 
 typedef UInt32 CLzRef;
 
+/* LZMA_ENC_STATS: the searches count what they visit, see CLzmaEncStats */
+#ifdef LZMA_ENC_STATS
+typedef struct
+{
+  UInt64 numChainSteps; /* candidates compared */
+  UInt64 numChainCuts;  /* searches stopped by cutValue, not by the end of the chain */
+} CMatchFinderStats;
+#define MF_STATS_PARAM , CMatchFinderStats *stats
+#define MF_STATS_ARG(stats) , (stats)
+#else
+#define MF_STATS_PARAM
+#define MF_STATS_ARG(stats)
+#endif
+
 typedef struct _CMatchFinder
 {
   Byte *buffer;
@@ -46,8 +60,12 @@ typedef struct _CMatchFinder
   UInt32 fixedHashSize;
   UInt32 hashSizeSum;
   UInt32 numSons;
+  int hashIsValid; /* hash and son only hold positions <= pos, see MatchFinder_Init */
   SRes result;
   UInt32 crc[256];
+  #ifdef LZMA_ENC_STATS
+  CMatchFinderStats stats;
+  #endif
 } CMatchFinder;
 
 #define Inline_MatchFinder_GetPointerToCurrentPos(p) ((p)->buffer)
@@ -69,13 +87,20 @@ void MatchFinder_Construct(CMatchFinder *p);
 int MatchFinder_Create(CMatchFinder *p, UInt32 historySize,
     UInt32 keepAddBufferBefore, UInt32 matchMaxLen, UInt32 keepAddBufferAfter,
     ISzAlloc *alloc);
+/* the bytes MatchFinder_Create allocates (window, hash and son), without the window if directInput */
+UInt64 MatchFinder_GetMemUsage(UInt32 historySize,
+    UInt32 keepAddBufferBefore, UInt32 matchMaxLen, UInt32 keepAddBufferAfter,
+    int btMode, UInt32 numHashBytes, int directInput);
 void MatchFinder_Free(CMatchFinder *p, ISzAlloc *alloc);
 void MatchFinder_Normalize3(UInt32 subValue, CLzRef *items, UInt32 numItems);
 void MatchFinder_ReduceOffsets(CMatchFinder *p, UInt32 subValue);
 
+/* the first i in [len, lenLimit) with pb[i] != cur[i], or lenLimit. SIMD if the CPU has it */
+UInt32 MatchFinder_GetMatchLen(const Byte *pb, const Byte *cur, UInt32 len, UInt32 lenLimit);
+
 UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *buffer, CLzRef *son,
     UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 _cutValue,
-    UInt32 *distances, UInt32 maxLen);
+    UInt32 *distances, UInt32 maxLen MF_STATS_PARAM);
 
 /*
 Conditions:
@@ -0,0 +1,250 @@
+/* Lzma2DecMt.c -- LZMA2 block-parallel Decoder
+2011-06-20 : Public domain */
+
+#include "Lzma2DecMt.h"
+
+#ifndef _7ZIP_ST
+#include "Threads.h"
+#define NUM_DEC_THREADS_MAX 32
+#endif
+
+#define LZMA2_CONTROL_LZMA (1 << 7)
+#define LZMA2_CONTROL_COPY_NO_RESET 2
+#define LZMA2_CONTROL_COPY_RESET_DIC 1
+#define LZMA2_CONTROL_EOF 0
+
+#define LZMA2_IS_RESET_DIC(control) ((control) == LZMA2_CONTROL_COPY_RESET_DIC || ((control) >> 5) == 7)
+
+SRes Lzma2Dec_FindBlocks(const Byte *src, SizeT srcLen, CLzma2Block *blocks, SizeT *numBlocks,
+    UInt64 *unpackSize, SizeT *packSize)
+{
+  SizeT maxBlocks = *numBlocks;
+  SizeT pos = 0;
+  SizeT num = 0;
+  UInt64 unpackPos = 0;
+  CLzma2Block *cur = NULL;
+
+  *numBlocks = 0;
+  *unpackSize = 0;
+  *packSize = 0;
+  for (;;)
+  {
+    Byte control;
+    UInt32 u, pack;
+    if (pos == srcLen)
+      return SZ_ERROR_INPUT_EOF;
+    control = src[pos];
+    if (control == LZMA2_CONTROL_EOF)
+    {
+      pos++;
+      break;
+    }
+    if (control & LZMA2_CONTROL_LZMA)
+    {
+      unsigned headerSize = ((control >> 5) & 3) >= 2 ? 6 : 5;
+      if (srcLen - pos < headerSize)
+        return SZ_ERROR_INPUT_EOF;
+      u = (((UInt32)(control & 0x1F) << 16) | ((UInt32)src[pos + 1] << 8) | src[pos + 2]) + 1;
+      pack = (((UInt32)src[pos + 3] << 8) | src[pos + 4]) + 1;
+      pack += headerSize;
+    }
+    else
+    {
+      if (control > LZMA2_CONTROL_COPY_NO_RESET)
+        return SZ_ERROR_DATA;
+      if (srcLen - pos < 3)
+        return SZ_ERROR_INPUT_EOF;
+      u = (((UInt32)src[pos + 1] << 8) | src[pos + 2]) + 1;
+      pack = u + 3;
+    }
+    if (LZMA2_IS_RESET_DIC(control))
+    {
+      if (cur)
+        cur->packSize = pos - cur->packPos;
+      cur = NULL;
+      if (blocks)
+      {
+        if (num == maxBlocks)
+          return SZ_ERROR_OUTPUT_EOF;
+        cur = &blocks[num];
+        cur->packPos = pos;
+        cur->unpackPos = unpackPos;
+        cur->unpackSize = 0;
+      }
+      num++;
+    }
+    else if (num == 0)
+      return SZ_ERROR_DATA;
+    if (srcLen - pos < pack)
+      return SZ_ERROR_INPUT_EOF;
+    pos += pack;
+    unpackPos += u;
+    if (cur)
+      cur->unpackSize += u;
+  }
+  if (cur)
+    cur->packSize = pos - 1 - cur->packPos;
+  *numBlocks = num;
+  *unpackSize = unpackPos;
+  *packSize = pos;
+  return SZ_OK;
+}
+
+static SRes Lzma2Block_Decode(CLzma2Dec *dec, Byte *dest, const Byte *src, const CLzma2Block *block)
+{
+  SizeT srcLen = block->packSize;
+  ELzmaStatus status;
+  SRes res;
+  dec->decoder.dic = dest + (SizeT)block->unpackPos;
+  dec->decoder.dicBufSize = (SizeT)block->unpackSize;
+  Lzma2Dec_Init(dec);
+  res = Lzma2Dec_DecodeToDic(dec, (SizeT)block->unpackSize, src + block->packPos, &srcLen, LZMA_FINISH_ANY, &status);
+  dec->decoder.dic = NULL;
+  RINOK(res);
+  if (srcLen != block->packSize || dec->decoder.dicPos != (SizeT)block->unpackSize)
+    return SZ_ERROR_DATA;
+  return SZ_OK;
+}
+
+typedef struct
+{
+  Byte *dest;
+  const Byte *src;
+  const CLzma2Block *blocks;
+  SizeT numBlocks;
+  Byte prop;
+  ICompressProgress *progress;
+  ISzAlloc *alloc;
+
+  SizeT nextBlock;
+  UInt64 inSize;
+  UInt64 outSize;
+  SRes res;
+  #ifndef _7ZIP_ST
+  CCriticalSection cs;
+  #endif
+} CLzma2DecMt;
+
+#ifndef _7ZIP_ST
+#define Lzma2DecMt_Lock(p) CriticalSection_Enter(&(p)->cs)
+#define Lzma2DecMt_Unlock(p) CriticalSection_Leave(&(p)->cs)
+#else
+#define Lzma2DecMt_Lock(p)
+#define Lzma2DecMt_Unlock(p)
+#endif
+
+/* takes the next block until all are done or one fails */
+static void Lzma2DecMt_Run(CLzma2DecMt *p)
+{
+  CLzma2Dec dec;
+  SRes res;
+  Lzma2Dec_Construct(&dec);
+  res = Lzma2Dec_AllocateProbs(&dec, p->prop, p->alloc);
+  for (;;)
+  {
+    const CLzma2Block *block;
+    Lzma2DecMt_Lock(p);
+    if (res != SZ_OK && p->res == SZ_OK)
+      p->res = res;
+    if (p->res != SZ_OK || p->nextBlock == p->numBlocks)
+    {
+      Lzma2DecMt_Unlock(p);
+      break;
+    }
+    block = &p->blocks[p->nextBlock++];
+    Lzma2DecMt_Unlock(p);
+
+    res = Lzma2Block_Decode(&dec, p->dest, p->src, block);
+    if (res == SZ_OK)
+    {
+      Lzma2DecMt_Lock(p);
+      p->inSize += block->packSize;
+      p->outSize += block->unpackSize;
+      if (p->progress && p->res == SZ_OK && p->progress->Progress(p->progress, p->inSize, p->outSize) != SZ_OK)
+        res = SZ_ERROR_PROGRESS;
+      Lzma2DecMt_Unlock(p);
+    }
+  }
+  Lzma2Dec_FreeProbs(&dec, p->alloc);
+}
+
+#ifndef _7ZIP_ST
+static THREAD_FUNC_RET_TYPE THREAD_FUNC_CALL_TYPE Lzma2DecMt_ThreadFunc(void *pp)
+{
+  Lzma2DecMt_Run((CLzma2DecMt *)pp);
+  return 0;
+}
+#endif
+
+SRes Lzma2DecodeMt(Byte *dest, SizeT *destLen, const Byte *src, SizeT *srcLen,
+    Byte prop, unsigned numThreads, ICompressProgress *progress, ISzAlloc *alloc)
+{
+  CLzma2DecMt p;
+  CLzma2Block *blocks;
+  SizeT numBlocks = 0, packSize;
+  UInt64 unpackSize;
+  SizeT outSize = *destLen;
+
+  *destLen = 0;
+  RINOK(Lzma2Dec_FindBlocks(src, *srcLen, NULL, &numBlocks, &unpackSize, &packSize));
+  if (unpackSize > outSize)
+    return SZ_ERROR_OUTPUT_EOF;
+  *srcLen = packSize;
+  if (numBlocks == 0)
+    return SZ_OK;
+  blocks = (CLzma2Block *)alloc->Alloc(alloc, numBlocks * sizeof(CLzma2Block));
+  if (blocks == 0)
+    return SZ_ERROR_MEM;
+  Lzma2Dec_FindBlocks(src, packSize, blocks, &numBlocks, &unpackSize, &packSize);
+
+  p.dest = dest;
+  p.src = src;
+  p.blocks = blocks;
+  p.numBlocks = numBlocks;
+  p.prop = prop;
+  p.progress = progress;
+  p.alloc = alloc;
+  p.nextBlock = 0;
+  p.inSize = 0;
+  p.outSize = 0;
+  p.res = SZ_OK;
+
+  #ifndef _7ZIP_ST
+  if (numThreads > NUM_DEC_THREADS_MAX)
+    numThreads = NUM_DEC_THREADS_MAX;
+  if (numThreads > numBlocks)
+    numThreads = (unsigned)numBlocks;
+  if (CriticalSection_Init(&p.cs) != 0)
+  {
+    alloc->Free(alloc, blocks);
+    return SZ_ERROR_THREAD;
+  }
+  {
+    CThread threads[NUM_DEC_THREADS_MAX];
+    unsigned i, numCreated = 0;
+    /* the calling thread decodes too */
+    for (i = 1; i < numThreads; i++)
+    {
+      Thread_Construct(&threads[i]);
+      if (Thread_Create(&threads[i], Lzma2DecMt_ThreadFunc, &p) != 0)
+        break;
+      numCreated++;
+    }
+    Lzma2DecMt_Run(&p);
+    for (i = 1; i <= numCreated; i++)
+    {
+      Thread_Wait(&threads[i]);
+      Thread_Close(&threads[i]);
+    }
+  }
+  CriticalSection_Delete(&p.cs);
+  #else
+  numThreads = numThreads;
+  Lzma2DecMt_Run(&p);
+  #endif
+
+  alloc->Free(alloc, blocks);
+  if (p.res == SZ_OK)
+    *destLen = (SizeT)unpackSize;
+  return p.res;
+}
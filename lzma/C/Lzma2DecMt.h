@@ -0,0 +1,67 @@
+/* Lzma2DecMt.h -- LZMA2 block-parallel Decoder
+2011-06-20 : Public domain */
+
+#ifndef __LZMA2_DEC_MT_H
+#define __LZMA2_DEC_MT_H
+
+#include "Lzma2Dec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+A block starts with a chunk that resets the dictionary
+(LZMA2_CONTROL_COPY_RESET_DIC or LZMA with state + prop + dic reset).
+It doesn't depend on the data before it, so the blocks can be decoded in any order.
+*/
+
+typedef struct
+{
+  SizeT packPos;     /* offset of the first chunk in src */
+  SizeT packSize;    /* chunk bytes, up to the next block or the end marker */
+  UInt64 unpackPos;
+  UInt64 unpackSize;
+} CLzma2Block;
+
+/* Lzma2Dec_FindBlocks
+  Walks the chunk headers of src without decoding.
+  blocks can be NULL to count the blocks only. Otherwise it has *numBlocks items.
+  *numBlocks   - number of blocks found
+  *unpackSize  - total unpacked size
+  *packSize    - size of the stream including the end marker
+Returns:
+  SZ_OK
+  SZ_ERROR_DATA       - bad control byte, or the first chunk doesn't reset the dictionary
+  SZ_ERROR_INPUT_EOF  - src ends before the end marker
+  SZ_ERROR_OUTPUT_EOF - there are more than *numBlocks blocks
+*/
+
+SRes Lzma2Dec_FindBlocks(const Byte *src, SizeT srcLen, CLzma2Block *blocks, SizeT *numBlocks,
+    UInt64 *unpackSize, SizeT *packSize);
+
+/* Lzma2DecodeMt
+  Decodes the blocks of a complete LZMA2 stream on numThreads threads.
+  Every block is decoded straight to its offset in dest, which is the dictionary
+  too, so there is no copy and the memory is the probs of each thread.
+  *destLen must be >= the unpacked size (see Lzma2Dec_FindBlocks).
+  progress is called from the decoding threads after each block (with a lock held).
+Returns:
+  SZ_OK
+  SZ_ERROR_DATA        - Data error
+  SZ_ERROR_MEM         - Memory allocation error
+  SZ_ERROR_UNSUPPORTED - Unsupported properties
+  SZ_ERROR_INPUT_EOF   - src ends before the end marker
+  SZ_ERROR_OUTPUT_EOF  - dest is too small
+  SZ_ERROR_PROGRESS    - some break from progress callback
+  SZ_ERROR_THREAD      - errors in multithreading functions (only for Mt version)
+*/
+
+SRes Lzma2DecodeMt(Byte *dest, SizeT *destLen, const Byte *src, SizeT *srcLen,
+    Byte prop, unsigned numThreads, ICompressProgress *progress, ISzAlloc *alloc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
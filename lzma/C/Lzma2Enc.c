@@ -67,6 +67,7 @@ const Byte *LzmaEnc_GetCurBuf(CLzmaEncHandle pp);
 void LzmaEnc_Finish(CLzmaEncHandle pp);
 void LzmaEnc_SaveState(CLzmaEncHandle pp);
 void LzmaEnc_RestoreState(CLzmaEncHandle pp);
+void LzmaEnc_ResetStats(CLzmaEncHandle pp);
 
 
 static SRes Lzma2EncInt_EncodeSubblock(CLzma2EncInt *p, Byte *outBuf,
@@ -259,13 +260,59 @@ typedef struct
 } CLzma2Enc;
 
 
+UInt64 Lzma2Enc_GetMemUsage(const CLzma2EncProps *props2)
+{
+  CLzma2EncProps props = *props2;
+  Lzma2EncProps_Normalize(&props);
+  #ifndef _7ZIP_ST
+  if (props.numBlockThreads > 1)
+  {
+    /* every thread encodes its block in memory: the block is the window */
+    UInt64 perThread = LzmaEnc_GetMemUsage(&props.lzmaProps, LZMA2_KEEP_WINDOW_SIZE, True) +
+        props.blockSize + (props.blockSize + (props.blockSize >> 10) + 16);
+    return (UInt64)props.numBlockThreads * perThread + sizeof(CLzma2Enc);
+  }
+  #endif
+  return LzmaEnc_GetMemUsage(&props.lzmaProps, LZMA2_KEEP_WINDOW_SIZE, False) +
+      LZMA2_CHUNK_SIZE_COMPRESSED_MAX + sizeof(CLzma2Enc);
+}
+
 /* ---------- Lzma2EncThread ---------- */
 
+/* Lets the single thread coder stop at props.blockSize, so it starts a new block
+   (dictionary reset) at the same positions as the MtCoder path does */
+typedef struct
+{
+  ISeqInStream funcTable;
+  ISeqInStream *realStream;
+  UInt64 rem;
+  Bool finished;
+} CLimitedSeqInStream;
+
+static SRes LimitedSeqInStream_Read(void *pp, void *data, size_t *size)
+{
+  CLimitedSeqInStream *p = (CLimitedSeqInStream *)pp;
+  size_t size2 = *size;
+  SRes res = SZ_OK;
+  if (p->rem < size2)
+    size2 = (size_t)p->rem;
+  if (size2 != 0)
+  {
+    res = p->realStream->Read(p->realStream, data, &size2);
+    p->finished = (size2 == 0);
+    p->rem -= size2;
+  }
+  *size = size2;
+  return res;
+}
+
 static SRes Lzma2Enc_EncodeMt1(CLzma2EncInt *p, CLzma2Enc *mainEncoder,
   ISeqOutStream *outStream, ISeqInStream *inStream, ICompressProgress *progress)
 {
   UInt64 packTotal = 0;
+  UInt64 unpackTotal = 0;
   SRes res = SZ_OK;
+  CLimitedSeqInStream limitedInStream;
 
   if (mainEncoder->outBuf == 0)
   {
@@ -273,23 +320,38 @@ static SRes Lzma2Enc_EncodeMt1(CLzma2EncInt *p, CLzma2Enc *mainEncoder,
     if (mainEncoder->outBuf == 0)
       return SZ_ERROR_MEM;
   }
-  RINOK(Lzma2EncInt_Init(p, &mainEncoder->props));
-  RINOK(LzmaEnc_PrepareForLzma2(p->enc, inStream, LZMA2_KEEP_WINDOW_SIZE,
-      mainEncoder->alloc, mainEncoder->allocBig));
-  for (;;)
+  limitedInStream.funcTable.Read = LimitedSeqInStream_Read;
+  limitedInStream.realStream = inStream;
+  limitedInStream.finished = False;
+  while (res == SZ_OK && !limitedInStream.finished)
   {
-    size_t packSize = LZMA2_CHUNK_SIZE_COMPRESSED_MAX;
-    res = Lzma2EncInt_EncodeSubblock(p, mainEncoder->outBuf, &packSize, outStream);
-    if (res != SZ_OK)
-      break;
-    packTotal += packSize;
-    res = Progress(progress, p->srcPos, packTotal);
+    limitedInStream.rem = mainEncoder->props.blockSize;
+    res = Lzma2EncInt_Init(p, &mainEncoder->props);
+    if (res == SZ_OK)
+      res = LzmaEnc_PrepareForLzma2(p->enc, &limitedInStream.funcTable, LZMA2_KEEP_WINDOW_SIZE,
+          mainEncoder->alloc, mainEncoder->allocBig);
     if (res != SZ_OK)
+    {
+      /* release the match finder of a partly prepared encoder */
+      LzmaEnc_Finish(p->enc);
       break;
-    if (packSize == 0)
-      break;
+    }
+    for (;;)
+    {
+      size_t packSize = LZMA2_CHUNK_SIZE_COMPRESSED_MAX;
+      res = Lzma2EncInt_EncodeSubblock(p, mainEncoder->outBuf, &packSize, outStream);
+      if (res != SZ_OK)
+        break;
+      packTotal += packSize;
+      res = Progress(progress, unpackTotal + p->srcPos, packTotal);
+      if (res != SZ_OK)
+        break;
+      if (packSize == 0)
+        break;
+    }
+    unpackTotal += p->srcPos;
+    LzmaEnc_Finish(p->enc);
   }
-  LzmaEnc_Finish(p->enc);
   if (res == SZ_OK)
   {
     Byte b = 0;
@@ -420,6 +482,36 @@ SRes Lzma2Enc_SetProps(CLzma2EncHandle pp, const CLzma2EncProps *props)
   return SZ_OK;
 }
 
+SRes Lzma2Enc_GetStats(CLzma2EncHandle pp, CLzmaEncStats *stats)
+{
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  int i;
+  memset(stats, 0, sizeof(*stats));
+  for (i = 0; i < p->props.numBlockThreads; i++)
+  {
+    CLzmaEncStats s;
+    if (p->coders[i].enc == 0)
+      continue;
+    RINOK(LzmaEnc_GetStats(p->coders[i].enc, &s));
+    stats->cutValue = s.cutValue;
+    stats->numGetMatches += s.numGetMatches;
+    stats->numSkipped += s.numSkipped;
+    stats->numChainSteps += s.numChainSteps;
+    stats->numChainCuts += s.numChainCuts;
+    stats->numOptimumParses += s.numOptimumParses;
+    stats->optimumParseLength += s.optimumParseLength;
+    stats->numLiterals += s.numLiterals;
+    stats->numMatches += s.numMatches;
+    stats->numReps += s.numReps;
+    stats->numShortReps += s.numShortReps;
+    stats->matchLength += s.matchLength;
+    stats->numPriceUpdates += s.numPriceUpdates;
+    stats->numFlushes += s.numFlushes;
+    stats->flushedSize += s.flushedSize;
+  }
+  return SZ_OK;
+}
+
 Byte Lzma2Enc_WriteProperties(CLzma2EncHandle pp)
 {
   CLzma2Enc *p = (CLzma2Enc *)pp;
@@ -446,6 +538,7 @@ SRes Lzma2Enc_Encode(CLzma2EncHandle pp,
       if (t->enc == NULL)
         return SZ_ERROR_MEM;
     }
+    LzmaEnc_ResetStats(t->enc);
   }
 
   #ifndef _7ZIP_ST
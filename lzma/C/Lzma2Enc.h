@@ -13,13 +13,15 @@ extern "C" {
 typedef struct
 {
   CLzmaEncProps lzmaProps;
-  size_t blockSize;
+  size_t blockSize; /* every block starts with a dictionary reset. 0: auto (dictSize * 4, 1 MB..256 MB) */
   int numBlockThreads;
   int numTotalThreads;
 } CLzma2EncProps;
 
 void Lzma2EncProps_Init(CLzma2EncProps *p);
 void Lzma2EncProps_Normalize(CLzma2EncProps *p);
+/* the bytes Lzma2Enc_Encode allocates with these props (all the block threads) */
+UInt64 Lzma2Enc_GetMemUsage(const CLzma2EncProps *props);
 
 /* ---------- CLzmaEnc2Handle Interface ---------- */
 
@@ -41,6 +43,8 @@ SRes Lzma2Enc_SetProps(CLzma2EncHandle p, const CLzma2EncProps *props);
 Byte Lzma2Enc_WriteProperties(CLzma2EncHandle p);
 SRes Lzma2Enc_Encode(CLzma2EncHandle p,
     ISeqOutStream *outStream, ISeqInStream *inStream, ICompressProgress *progress);
+/* the sum over the block encoders of the last Lzma2Enc_Encode, see LzmaEnc_GetStats */
+SRes Lzma2Enc_GetStats(CLzma2EncHandle p, CLzmaEncStats *stats);
 
 /* ---------- One Call Interface ---------- */
 
@@ -1,10 +1,15 @@
 /* LzmaDec.c -- LZMA Decoder
 2009-09-20 : Igor Pavlov : Public domain */
 
+#include "CpuArch.h"
 #include "LzmaDec.h"
 
 #include <string.h>
 
+#ifdef MY_CPU_AMD64
+#include <emmintrin.h>
+#endif
+
 #define kNumTopBits 24
 #define kTopValue ((UInt32)1 << kNumTopBits)
 
@@ -425,6 +430,408 @@ static int MY_FAST_CALL LzmaDec_DecodeReal(CLzmaDec *p, SizeT limit, const Byte
   return SZ_OK;
 }
 
+/* ---------- Fast kernel ---------- */
+
+/* The fast kernel decodes the same symbols as LzmaDec_DecodeReal, but the
+   bits of the literal, length and distance trees are turned into a mask
+   (0 or 0xFFFFFFFF) that selects the new range, code and probability, so
+   the compiler can use cmov instead of a mispredicted jump. Only the bits
+   that decide the kind of the next symbol keep the IF_BIT_0 branches. */
+
+#define BIT_DEC_MASK(p) \
+  { ttt = *(p); NORMALIZE; bound = (range >> kNumBitModelTotalBits) * ttt; \
+  bitMask = (UInt32)0 - (UInt32)(code >= bound); \
+  code -= bound & bitMask; \
+  range = (bound & ~bitMask) | ((range - bound) & bitMask); \
+  *(p) = (CLzmaProb)(((ttt + ((kBitModelTotal - ttt) >> kNumMoveBits)) & ~bitMask) | \
+      ((ttt - (ttt >> kNumMoveBits)) & bitMask)); }
+
+#define GET_BIT_FAST(p, i) { BIT_DEC_MASK(p); i = (i + i) - (unsigned)bitMask; }
+#define TREE_GET_BIT_FAST(probs, i) GET_BIT_FAST((probs + i), i)
+
+#define TREE_DECODE_FAST(probs, limit, i) \
+  { i = 1; do { TREE_GET_BIT_FAST(probs, i); } while (i < limit); i -= limit; }
+
+#define TREE_6_DECODE_FAST(probs, i) \
+  { i = 1; \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  i -= 0x40; }
+
+#define LIT_DECODE_FAST(probs, i) \
+  { i = 1; \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); \
+  TREE_GET_BIT_FAST(probs, i); }
+
+#define MATCHED_LIT_GET_BIT_FAST(probs, i) \
+  { matchByte <<= 1; bit = (matchByte & offs); \
+  probLit = probs + offs + bit + i; \
+  GET_BIT_FAST(probLit, i); \
+  offs &= bit ^ ~(unsigned)bitMask; }
+
+#define MATCHED_LIT_DECODE_FAST(probs, i) \
+  { unsigned offs = 0x100, bit; CLzmaProb *probLit; i = 1; \
+  MATCHED_LIT_GET_BIT_FAST(probs, i); \
+  MATCHED_LIT_GET_BIT_FAST(probs, i); \
+  MATCHED_LIT_GET_BIT_FAST(probs, i); \
+  MATCHED_LIT_GET_BIT_FAST(probs, i); \
+  MATCHED_LIT_GET_BIT_FAST(probs, i); \
+  MATCHED_LIT_GET_BIT_FAST(probs, i); \
+  MATCHED_LIT_GET_BIT_FAST(probs, i); \
+  MATCHED_LIT_GET_BIT_FAST(probs, i); }
+
+/* Match copies go through a register, so a chunk is loaded before it is
+   stored and the source may overlap the destination by up to one chunk. */
+
+#define COPY_8(dest, src) { UInt64 t; memcpy(&t, (src), 8); memcpy((dest), &t, 8); }
+
+#ifdef MY_CPU_AMD64
+#define COPY_16(dest, src) _mm_storeu_si128((__m128i *)(void *)(dest), \
+    _mm_loadu_si128((const __m128i *)(const void *)(src)))
+#else
+#define COPY_16(dest, src) { UInt64 t0, t1; memcpy(&t0, (src), 8); memcpy(&t1, (src) + 8, 8); \
+    memcpy((dest), &t0, 8); memcpy((dest) + 8, &t1, 8); }
+#endif
+
+#define COPY_WIDE(size, COPY) \
+  { do { COPY(dest, dest + src); dest += size; } while (lim - dest > size); \
+  COPY(lim - size, lim - size + src); }
+
+/* LzmaDec_CopyMatch writes the same bytes as the byte loop
+     do *dest = *(dest + src); while (++dest != lim);
+   for a match whose source (dest + src) doesn't wrap around the dictionary:
+     src >= 0      : the source is ahead of dest (after a dictionary wrap),
+                     so no byte is read after it was written: memmove.
+     src == -1     : a run of one byte: memset.
+     src <= -8     : 16- or 8-byte chunks; a chunk never reads bytes it writes.
+     -7 <= src < -1: the first bytes are copied one by one until the period
+                     repeats at a distance >= 8, then 8-byte chunks from there. */
+
+static void LzmaDec_CopyMatch(Byte *dest, ptrdiff_t src, unsigned len)
+{
+  Byte *lim = dest + len;
+  if (src >= 0)
+    memmove(dest, dest + src, len);
+  else if (src == -1)
+    memset(dest, dest[-1], len);
+  else if (src <= -16 && len >= 16)
+    COPY_WIDE(16, COPY_16)
+  else if (src <= -8 && len >= 8)
+    COPY_WIDE(8, COPY_8)
+  else if (src > -8 && len >= 32)
+  {
+    unsigned dist = (unsigned)-src;
+    unsigned dist8 = dist * ((8 + dist - 1) / dist);
+    const Byte *lim8 = dest + (dist8 - dist);
+    do
+      *(dest) = (Byte)*(dest + src);
+    while (++dest != lim8);
+    src = -(ptrdiff_t)dist8;
+    COPY_WIDE(8, COPY_8)
+  }
+  else
+  {
+    do
+      *(dest) = (Byte)*(dest + src);
+    while (++dest != lim);
+  }
+}
+
+static int MY_FAST_CALL LzmaDec_DecodeRealFast(CLzmaDec *p, SizeT limit, const Byte *bufLimit)
+{
+  CLzmaProb *probs = p->probs;
+
+  unsigned state = p->state;
+  UInt32 rep0 = p->reps[0], rep1 = p->reps[1], rep2 = p->reps[2], rep3 = p->reps[3];
+  unsigned pbMask = ((unsigned)1 << (p->prop.pb)) - 1;
+  unsigned lpMask = ((unsigned)1 << (p->prop.lp)) - 1;
+  unsigned lc = p->prop.lc;
+
+  Byte *dic = p->dic;
+  SizeT dicBufSize = p->dicBufSize;
+  SizeT dicPos = p->dicPos;
+  
+  UInt32 processedPos = p->processedPos;
+  UInt32 checkDicSize = p->checkDicSize;
+  unsigned len = 0;
+
+  const Byte *buf = p->buf;
+  UInt32 range = p->range;
+  UInt32 code = p->code;
+
+  do
+  {
+    CLzmaProb *prob;
+    UInt32 bound, bitMask;
+    unsigned ttt;
+    unsigned posState = processedPos & pbMask;
+
+    prob = probs + IsMatch + (state << kNumPosBitsMax) + posState;
+    IF_BIT_0(prob)
+    {
+      unsigned symbol;
+      UPDATE_0(prob);
+      prob = probs + Literal;
+      if (checkDicSize != 0 || processedPos != 0)
+        prob += (LZMA_LIT_SIZE * (((processedPos & lpMask) << lc) +
+        (dic[(dicPos == 0 ? dicBufSize : dicPos) - 1] >> (8 - lc))));
+
+      if (state < kNumLitStates)
+      {
+        state -= (state < 4) ? state : 3;
+        LIT_DECODE_FAST(prob, symbol);
+      }
+      else
+      {
+        unsigned matchByte = dic[(dicPos - rep0) + ((dicPos < rep0) ? dicBufSize : 0)];
+        state -= (state < 10) ? 3 : 6;
+        MATCHED_LIT_DECODE_FAST(prob, symbol);
+      }
+      dic[dicPos++] = (Byte)symbol;
+      processedPos++;
+      continue;
+    }
+    else
+    {
+      UPDATE_1(prob);
+      prob = probs + IsRep + state;
+      IF_BIT_0(prob)
+      {
+        UPDATE_0(prob);
+        state += kNumStates;
+        prob = probs + LenCoder;
+      }
+      else
+      {
+        UPDATE_1(prob);
+        if (checkDicSize == 0 && processedPos == 0)
+          return SZ_ERROR_DATA;
+        prob = probs + IsRepG0 + state;
+        IF_BIT_0(prob)
+        {
+          UPDATE_0(prob);
+          prob = probs + IsRep0Long + (state << kNumPosBitsMax) + posState;
+          IF_BIT_0(prob)
+          {
+            UPDATE_0(prob);
+            dic[dicPos] = dic[(dicPos - rep0) + ((dicPos < rep0) ? dicBufSize : 0)];
+            dicPos++;
+            processedPos++;
+            state = state < kNumLitStates ? 9 : 11;
+            continue;
+          }
+          UPDATE_1(prob);
+        }
+        else
+        {
+          UInt32 distance;
+          UPDATE_1(prob);
+          prob = probs + IsRepG1 + state;
+          IF_BIT_0(prob)
+          {
+            UPDATE_0(prob);
+            distance = rep1;
+          }
+          else
+          {
+            UPDATE_1(prob);
+            prob = probs + IsRepG2 + state;
+            IF_BIT_0(prob)
+            {
+              UPDATE_0(prob);
+              distance = rep2;
+            }
+            else
+            {
+              UPDATE_1(prob);
+              distance = rep3;
+              rep3 = rep2;
+            }
+            rep2 = rep1;
+          }
+          rep1 = rep0;
+          rep0 = distance;
+        }
+        state = state < kNumLitStates ? 8 : 11;
+        prob = probs + RepLenCoder;
+      }
+      {
+        CLzmaProb *probLen = prob + LenChoice;
+        IF_BIT_0(probLen)
+        {
+          UPDATE_0(probLen);
+          probLen = prob + LenLow + (posState << kLenNumLowBits);
+          len = 1;
+          TREE_GET_BIT_FAST(probLen, len);
+          TREE_GET_BIT_FAST(probLen, len);
+          TREE_GET_BIT_FAST(probLen, len);
+          len -= (1 << kLenNumLowBits);
+        }
+        else
+        {
+          UPDATE_1(probLen);
+          probLen = prob + LenChoice2;
+          IF_BIT_0(probLen)
+          {
+            UPDATE_0(probLen);
+            probLen = prob + LenMid + (posState << kLenNumMidBits);
+            len = 1;
+            TREE_GET_BIT_FAST(probLen, len);
+            TREE_GET_BIT_FAST(probLen, len);
+            TREE_GET_BIT_FAST(probLen, len);
+            len += kLenNumLowSymbols - (1 << kLenNumMidBits);
+          }
+          else
+          {
+            UPDATE_1(probLen);
+            probLen = prob + LenHigh;
+            LIT_DECODE_FAST(probLen, len);
+            len += kLenNumLowSymbols + kLenNumMidSymbols - (1 << kLenNumHighBits);
+          }
+        }
+      }
+
+      if (state >= kNumStates)
+      {
+        UInt32 distance;
+        prob = probs + PosSlot +
+            ((len < kNumLenToPosStates ? len : kNumLenToPosStates - 1) << kNumPosSlotBits);
+        TREE_6_DECODE_FAST(prob, distance);
+        if (distance >= kStartPosModelIndex)
+        {
+          unsigned posSlot = (unsigned)distance;
+          int numDirectBits = (int)(((distance >> 1) - 1));
+          distance = (2 | (distance & 1));
+          if (posSlot < kEndPosModelIndex)
+          {
+            distance <<= numDirectBits;
+            prob = probs + SpecPos + distance - posSlot - 1;
+            {
+              UInt32 mask = 1;
+              unsigned i = 1;
+              do
+              {
+                GET_BIT_FAST(prob + i, i);
+                distance |= mask & bitMask;
+                mask <<= 1;
+              }
+              while (--numDirectBits != 0);
+            }
+          }
+          else
+          {
+            numDirectBits -= kNumAlignBits;
+            do
+            {
+              NORMALIZE
+              range >>= 1;
+              
+              {
+                UInt32 t;
+                code -= range;
+                t = (0 - ((UInt32)code >> 31)); /* (UInt32)((Int32)code >> 31) */
+                distance = (distance << 1) + (t + 1);
+                code += range & t;
+              }
+            }
+            while (--numDirectBits != 0);
+            prob = probs + Align;
+            distance <<= kNumAlignBits;
+            {
+              unsigned i = 1;
+              GET_BIT_FAST(prob + i, i); distance |= 1 & bitMask;
+              GET_BIT_FAST(prob + i, i); distance |= 2 & bitMask;
+              GET_BIT_FAST(prob + i, i); distance |= 4 & bitMask;
+              GET_BIT_FAST(prob + i, i); distance |= 8 & bitMask;
+            }
+            if (distance == (UInt32)0xFFFFFFFF)
+            {
+              len += kMatchSpecLenStart;
+              state -= kNumStates;
+              break;
+            }
+          }
+        }
+        rep3 = rep2;
+        rep2 = rep1;
+        rep1 = rep0;
+        rep0 = distance + 1;
+        if (checkDicSize == 0)
+        {
+          if (distance >= processedPos)
+            return SZ_ERROR_DATA;
+        }
+        else if (distance >= checkDicSize)
+          return SZ_ERROR_DATA;
+        state = (state < kNumStates + kNumLitStates) ? kNumLitStates : kNumLitStates + 3;
+      }
+
+      len += kMatchMinLen;
+
+      if (limit == dicPos)
+        return SZ_ERROR_DATA;
+      {
+        SizeT rem = limit - dicPos;
+        unsigned curLen = ((rem < len) ? (unsigned)rem : len);
+        SizeT pos = (dicPos - rep0) + ((dicPos < rep0) ? dicBufSize : 0);
+
+        processedPos += curLen;
+
+        len -= curLen;
+        if (pos + curLen <= dicBufSize)
+        {
+          LzmaDec_CopyMatch(dic + dicPos, (ptrdiff_t)pos - (ptrdiff_t)dicPos, curLen);
+          dicPos += curLen;
+        }
+        else
+        {
+          do
+          {
+            dic[dicPos++] = dic[pos];
+            if (++pos == dicBufSize)
+              pos = 0;
+          }
+          while (--curLen != 0);
+        }
+      }
+    }
+  }
+  while (dicPos < limit && buf < bufLimit);
+  NORMALIZE;
+  p->buf = buf;
+  p->range = range;
+  p->code = code;
+  p->remainLen = len;
+  p->dicPos = dicPos;
+  p->processedPos = processedPos;
+  p->reps[0] = rep0;
+  p->reps[1] = rep1;
+  p->reps[2] = rep2;
+  p->reps[3] = rep3;
+  p->state = state;
+
+  return SZ_OK;
+}
+
+typedef int (MY_FAST_CALL *LzmaDec_DecodeRealFunc)(CLzmaDec *p, SizeT limit, const Byte *bufLimit);
+
+static LzmaDec_DecodeRealFunc g_DecodeReal = LzmaDec_DecodeRealFast;
+
+void LzmaDec_SetKernel(ELzmaDecKernel kernel)
+{
+  g_DecodeReal = (kernel == LZMA_DEC_KERNEL_REF) ? LzmaDec_DecodeReal : LzmaDec_DecodeRealFast;
+}
+
 static void MY_FAST_CALL LzmaDec_WriteRem(CLzmaDec *p, SizeT limit)
 {
   if (p->remainLen != 0 && p->remainLen < kMatchSpecLenStart)
@@ -442,10 +849,20 @@ static void MY_FAST_CALL LzmaDec_WriteRem(CLzmaDec *p, SizeT limit)
 
     p->processedPos += len;
     p->remainLen -= len;
-    while (len-- != 0)
     {
-      dic[dicPos] = dic[(dicPos - rep0) + ((dicPos < rep0) ? dicBufSize : 0)];
-      dicPos++;
+      SizeT pos = (dicPos - rep0) + ((dicPos < rep0) ? dicBufSize : 0);
+      /* the REF kernel keeps the byte loop, so comparing it with FAST also checks LzmaDec_CopyMatch */
+      if (len != 0 && g_DecodeReal == LzmaDec_DecodeRealFast && pos + len <= dicBufSize)
+      {
+        LzmaDec_CopyMatch(dic + dicPos, (ptrdiff_t)pos - (ptrdiff_t)dicPos, len);
+        dicPos += len;
+      }
+      else
+        while (len-- != 0)
+        {
+          dic[dicPos] = dic[(dicPos - rep0) + ((dicPos < rep0) ? dicBufSize : 0)];
+          dicPos++;
+        }
     }
     p->dicPos = dicPos;
   }
@@ -462,7 +879,7 @@ static int MY_FAST_CALL LzmaDec_DecodeReal2(CLzmaDec *p, SizeT limit, const Byte
       if (limit - p->dicPos > rem)
         limit2 = p->dicPos + rem;
     }
-    RINOK(LzmaDec_DecodeReal(p, limit2, bufLimit));
+    RINOK(g_DecodeReal(p, limit2, bufLimit));
     if (p->processedPos >= p->prop.dicSize)
       p->checkDicSize = p->prop.dicSize;
     LzmaDec_WriteRem(p, limit);
@@ -877,6 +1294,11 @@ SRes LzmaDec_DecodeToBuf(CLzmaDec *p, Byte *dest, SizeT *destLen, const Byte *sr
   }
 }
 
+UInt64 LzmaDec_GetMemUsage(unsigned lc, unsigned lp, UInt32 dicBufSize)
+{
+  return sizeof(CLzmaDec) + ((UInt64)LZMA_BASE_SIZE + ((UInt64)LZMA_LIT_SIZE << (lc + lp))) * sizeof(CLzmaProb) + dicBufSize;
+}
+
 void LzmaDec_FreeProbs(CLzmaDec *p, ISzAlloc *alloc)
 {
   alloc->Free(alloc, p->probs);
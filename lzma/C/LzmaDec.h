@@ -72,6 +72,20 @@ typedef struct
 
 void LzmaDec_Init(CLzmaDec *p);
 
+/* Decoding kernels. Both kernels produce the same output:
+     LZMA_DEC_KERNEL_REF  - the reference loop, one branch per decoded bit
+     LZMA_DEC_KERNEL_FAST - branchless tree bits and 8/16-byte match copies (default)
+   LzmaDec_SetKernel changes the kernel for all decoders of the process;
+   don't call it while some decoder is working. */
+
+typedef enum
+{
+  LZMA_DEC_KERNEL_REF,
+  LZMA_DEC_KERNEL_FAST
+} ELzmaDecKernel;
+
+void LzmaDec_SetKernel(ELzmaDecKernel kernel);
+
 /* There are two types of LZMA streams:
      0) Stream with end mark. That end mark adds about 6 bytes to compressed size.
      1) Stream without end mark. You must know exact uncompressed size to decompress such stream. */
@@ -135,6 +149,9 @@ SRes LzmaDec_AllocateProbs(CLzmaDec *p, const Byte *props, unsigned propsSize, I
 void LzmaDec_FreeProbs(CLzmaDec *p, ISzAlloc *alloc);
 
 SRes LzmaDec_Allocate(CLzmaDec *state, const Byte *prop, unsigned propsSize, ISzAlloc *alloc);
+
+/* the bytes of a decoder with these props and a dictionary of dicBufSize bytes */
+UInt64 LzmaDec_GetMemUsage(unsigned lc, unsigned lp, UInt32 dicBufSize);
 void LzmaDec_Free(CLzmaDec *state, ISzAlloc *alloc);
 
 /* ---------- Dictionary Interface ---------- */
@@ -21,6 +21,12 @@
 static int ttt = 0;
 #endif
 
+#ifdef LZMA_ENC_STATS
+#define ENC_STAT(x) x;
+#else
+#define ENC_STAT(x)
+#endif
+
 #define kBlockSizeMax ((1 << LZMA_NUM_BLOCK_SIZE_BITS) - 1)
 
 #define kBlockSize (9 << 10)
@@ -46,28 +52,42 @@ void LzmaEncProps_Init(CLzmaEncProps *p)
 {
   p->level = 5;
   p->dictSize = p->mc = 0;
-  p->lc = p->lp = p->pb = p->algo = p->fb = p->btMode = p->numHashBytes = p->numThreads = -1;
+  p->lc = p->lp = p->pb = p->algo = p->fb = p->btMode = p->numHashBytes = p->numThreads = p->priceMode = -1;
   p->writeEndMark = 0;
+  p->reduceSize = (UInt64)(Int64)-1;
 }
 
 void LzmaEncProps_Normalize(CLzmaEncProps *p)
 {
   int level = p->level;
-  if (level < 0) level = 5;
+  if (level < -2) level = 5;
   p->level = level;
-  if (p->dictSize == 0) p->dictSize = (level <= 5 ? (1 << (level * 2 + 14)) : (level == 6 ? (1 << 25) : (1 << 26)));
+  if (p->dictSize == 0) p->dictSize = (level < 0 ? (1 << (level * 2 + 20)) :
+      level <= 5 ? (1 << (level * 2 + 14)) : (level == 6 ? (1 << 25) : (1 << 26)));
+  if (p->dictSize > p->reduceSize)
+  {
+    /* the smallest 2^n or 3*2^n that holds the input, at least 4 KB */
+    unsigned i;
+    UInt32 reduceSize = (UInt32)p->reduceSize;
+    for (i = 11; i <= 30; i++)
+    {
+      if (reduceSize <= ((UInt32)2 << i)) { p->dictSize = ((UInt32)2 << i); break; }
+      if (reduceSize <= ((UInt32)3 << i)) { p->dictSize = ((UInt32)3 << i); break; }
+    }
+  }
   if (p->lc < 0) p->lc = 3;
   if (p->lp < 0) p->lp = 0;
   if (p->pb < 0) p->pb = 2;
-  if (p->algo < 0) p->algo = (level < 5 ? 0 : 1);
+  if (p->algo < 0) p->algo = (level < 0 ? 2 : (level < 5 ? 0 : 1));
   if (p->fb < 0) p->fb = (level < 7 ? 32 : 64);
-  if (p->btMode < 0) p->btMode = (p->algo == 0 ? 0 : 1);
+  if (p->btMode < 0) p->btMode = (p->algo == 2 ? 2 : (p->algo == 0 ? 0 : 1));
   if (p->numHashBytes < 0) p->numHashBytes = 4;
+  if (p->priceMode < 0) p->priceMode = 0;
   if (p->mc == 0)  p->mc = (16 + (p->fb >> 1)) >> (p->btMode ? 0 : 1);
   if (p->numThreads < 0)
     p->numThreads =
       #ifndef _7ZIP_ST
-      ((p->btMode && p->algo) ? 2 : 1);
+      ((p->btMode == 1 && p->algo == 1) ? 2 : 1);
       #else
       1;
       #endif
@@ -216,6 +236,9 @@ typedef struct
   UInt32 prices[LZMA_NUM_PB_STATES_MAX][kLenNumSymbolsTotal];
   UInt32 tableSize;
   UInt32 counters[LZMA_NUM_PB_STATES_MAX];
+  CLenEnc priced;                         /* the probabilities of prices, for priceMode 1 */
+  UInt32 movedParts[LZMA_NUM_PB_STATES_MAX];
+  UInt32 movedShared;
 } CLenPriceEnc;
 
 typedef struct
@@ -230,6 +253,10 @@ typedef struct
   ISeqOutStream *outStream;
   UInt64 processed;
   SRes res;
+  #ifdef LZMA_ENC_STATS
+  UInt64 numFlushes;
+  UInt64 flushedSize;
+  #endif
 } CRangeEnc;
 
 typedef struct
@@ -293,6 +320,7 @@ typedef struct
   UInt32 distancesPrices[kNumLenToPosStates][kNumFullDistances];
   UInt32 alignPrices[kAlignTableSize];
   UInt32 alignPriceCount;
+  UInt32 footerPrices[kNumFullDistances];
 
   UInt32 distTableSize;
 
@@ -318,6 +346,18 @@ typedef struct
   unsigned lclp;
 
   Bool fastMode;
+  Bool greedyMode;
+  Bool incPrices;
+  UInt32 numMisses; /* greedyMode: searches without a match since the last match */
+
+  /* priceMode 1: the probabilities that the distance tables were priced with,
+     and the trees with a probability that moved since */
+  CLzmaProb pricedPosSlot[kNumLenToPosStates][1 << kNumPosSlotBits];
+  CLzmaProb pricedPos[kNumFullDistances - kEndPosModelIndex];
+  CLzmaProb pricedAlign[1 << kNumAlignBits];
+  UInt32 movedPosSlots;
+  UInt32 movedPos;
+  Bool movedAlign;
   
   CRangeEnc rc;
 
@@ -334,6 +374,10 @@ typedef struct
   int needInit;
 
   CSaveState saveState;
+
+  #ifdef LZMA_ENC_STATS
+  CLzmaEncStats stats;
+  #endif
 } CLzmaEnc;
 
 void LzmaEnc_SaveState(CLzmaEncHandle pp)
@@ -388,6 +432,29 @@ void LzmaEnc_RestoreState(CLzmaEncHandle pp)
   memcpy(dest->litProbs, p->litProbs, (0x300 << dest->lclp) * sizeof(CLzmaProb));
 }
 
+static unsigned GetNumFastBytes(const CLzmaEncProps *props)
+{
+  unsigned fb = props->fb;
+  if (fb < 5)
+    fb = 5;
+  if (fb > LZMA_MATCH_LEN_MAX)
+    fb = LZMA_MATCH_LEN_MAX;
+  return fb;
+}
+
+static UInt32 GetNumHashBytes(const CLzmaEncProps *props)
+{
+  UInt32 numHashBytes = 4;
+  if (props->btMode == 1)
+  {
+    if (props->numHashBytes < 2)
+      numHashBytes = 2;
+    else if (props->numHashBytes < 4)
+      numHashBytes = props->numHashBytes;
+  }
+  return numHashBytes;
+}
+
 SRes LzmaEnc_SetProps(CLzmaEncHandle pp, const CLzmaEncProps *props2)
 {
   CLzmaEnc *p = (CLzmaEnc *)pp;
@@ -399,30 +466,15 @@ SRes LzmaEnc_SetProps(CLzmaEncHandle pp, const CLzmaEncProps *props2)
     return SZ_ERROR_PARAM;
   p->dictSize = props.dictSize;
   p->matchFinderCycles = props.mc;
-  {
-    unsigned fb = props.fb;
-    if (fb < 5)
-      fb = 5;
-    if (fb > LZMA_MATCH_LEN_MAX)
-      fb = LZMA_MATCH_LEN_MAX;
-    p->numFastBytes = fb;
-  }
+  p->numFastBytes = GetNumFastBytes(&props);
   p->lc = props.lc;
   p->lp = props.lp;
   p->pb = props.pb;
-  p->fastMode = (props.algo == 0);
+  p->fastMode = (props.algo != 1);
+  p->greedyMode = (props.algo == 2);
+  p->incPrices = (props.priceMode == 1 && !p->fastMode);
   p->matchFinderBase.btMode = props.btMode;
-  {
-    UInt32 numHashBytes = 4;
-    if (props.btMode)
-    {
-      if (props.numHashBytes < 2)
-        numHashBytes = 2;
-      else if (props.numHashBytes < 4)
-        numHashBytes = props.numHashBytes;
-    }
-    p->matchFinderBase.numHashBytes = numHashBytes;
-  }
+  p->matchFinderBase.numHashBytes = GetNumHashBytes(&props);
 
   p->matchFinderBase.cutValue = props.mc;
 
@@ -503,6 +555,8 @@ static void RangeEnc_FlushStream(CRangeEnc *p)
   if (num != p->outStream->Write(p->outStream, p->bufBase, num))
     p->res = SZ_ERROR_WRITE;
   p->processed += num;
+  ENC_STAT(p->numFlushes++)
+  ENC_STAT(p->flushedSize += num)
   p->buf = p->bufBase;
 }
 
@@ -690,31 +744,87 @@ static void RcTree_ReverseEncode(CRangeEnc *rc, CLzmaProb *probs, int numBitLeve
   }
 }
 
-static UInt32 RcTree_GetPrice(const CLzmaProb *probs, int numBitLevels, UInt32 symbol, UInt32 *ProbPrices)
+/* RcTree_GetPrices writes startPrice + the price of each symbol below numSymbols.
+   The tree is walked top-down: a node costs its parent plus one bit, so each
+   node that leads to one of the symbols is priced once, instead of every
+   symbol summing the whole path from the root (numBitLevels <= 8). */
+
+static void RcTree_GetPrices(const CLzmaProb *probs, unsigned numBitLevels, UInt32 numSymbols,
+    UInt32 startPrice, UInt32 *prices, UInt32 *ProbPrices)
+{
+  UInt32 nodePrices[1 << kLenNumHighBits];
+  unsigned level;
+  UInt32 i;
+  nodePrices[1] = startPrice;
+  for (level = 1; level < numBitLevels; level++)
+  {
+    UInt32 m = (UInt32)1 << level;
+    UInt32 lim = m + ((numSymbols - 1) >> (numBitLevels - level)) + 1;
+    for (; m < lim; m++)
+      nodePrices[m] = nodePrices[m >> 1] + GET_PRICEa(probs[m >> 1], m & 1);
+  }
+  for (i = 0; i < numSymbols; i++)
+  {
+    UInt32 m = ((UInt32)1 << numBitLevels) + i;
+    prices[i] = nodePrices[m >> 1] + GET_PRICEa(probs[m >> 1], m & 1);
+  }
+}
+
+/* reverse trees code the low bit first: the price of a symbol is the price
+   of the forward tree leaf with its bits reversed (numBitLevels <= 5) */
+
+static void RcTree_ReverseGetPrices(const CLzmaProb *probs, unsigned numBitLevels, UInt32 *prices, UInt32 *ProbPrices)
 {
-  UInt32 price = 0;
-  symbol |= (1 << numBitLevels);
+  UInt32 leafPrices[1 << (kEndPosModelIndex / 2 - 2)];
+  UInt32 numSymbols = (UInt32)1 << numBitLevels;
+  UInt32 i;
+  RcTree_GetPrices(probs, numBitLevels, numSymbols, 0, leafPrices, ProbPrices);
+  for (i = 0; i < numSymbols; i++)
+  {
+    UInt32 rev = 0, sym = i;
+    unsigned k;
+    for (k = numBitLevels; k != 0; k--)
+    {
+      rev = (rev << 1) | (sym & 1);
+      sym >>= 1;
+    }
+    prices[i] = leafPrices[rev];
+  }
+}
+
+/* priceMode 1 rebuilds a price table when one of its probabilities has moved by
+   kPriceMoveThreshold steps of ProbPrices[] since the table was priced. Only the
+   probabilities on the path of a coded symbol change, so only they are checked. */
+
+#define kPriceMoveThreshold 2
+
+#define PROB_MOVED(prob, priced) \
+  ((unsigned)((int)((prob) >> kNumMoveReducingBits) - (int)((priced) >> kNumMoveReducingBits) + \
+  (kPriceMoveThreshold - 1)) > 2 * (kPriceMoveThreshold - 1))
+
+static Bool RcTree_Moved(const CLzmaProb *probs, const CLzmaProb *priced, unsigned numBitLevels, UInt32 symbol)
+{
+  symbol |= ((UInt32)1 << numBitLevels);
   while (symbol != 1)
   {
-    price += GET_PRICEa(probs[symbol >> 1], symbol & 1);
     symbol >>= 1;
+    if (PROB_MOVED(probs[symbol], priced[symbol]))
+      return True;
   }
-  return price;
+  return False;
 }
 
-static UInt32 RcTree_ReverseGetPrice(const CLzmaProb *probs, int numBitLevels, UInt32 symbol, UInt32 *ProbPrices)
+static Bool RcTree_ReverseMoved(const CLzmaProb *probs, const CLzmaProb *priced, unsigned numBitLevels, UInt32 symbol)
 {
-  UInt32 price = 0;
   UInt32 m = 1;
-  int i;
-  for (i = numBitLevels; i != 0; i--)
+  for (; numBitLevels != 0; numBitLevels--)
   {
-    UInt32 bit = symbol & 1;
+    if (PROB_MOVED(probs[m], priced[m]))
+      return True;
+    m = (m << 1) | (symbol & 1);
     symbol >>= 1;
-    price += GET_PRICEa(probs[m], bit);
-    m = (m << 1) | bit;
   }
-  return price;
+  return False;
 }
 
 
@@ -753,32 +863,37 @@ static void LenEnc_Encode(CLenEnc *p, CRangeEnc *rc, UInt32 symbol, UInt32 posSt
   }
 }
 
-static void LenEnc_SetPrices(CLenEnc *p, UInt32 posState, UInt32 numSymbols, UInt32 *prices, UInt32 *ProbPrices)
+#define kLenPricesLow 1
+#define kLenPricesMid 2
+#define kLenPricesHigh 4
+#define kLenPricesAll (kLenPricesLow | kLenPricesMid | kLenPricesHigh)
+
+static void LenEnc_SetPrices(CLenEnc *p, UInt32 posState, UInt32 numSymbols, UInt32 *prices, UInt32 parts, UInt32 *ProbPrices)
 {
   UInt32 a0 = GET_PRICE_0a(p->choice);
   UInt32 a1 = GET_PRICE_1a(p->choice);
   UInt32 b0 = a1 + GET_PRICE_0a(p->choice2);
   UInt32 b1 = a1 + GET_PRICE_1a(p->choice2);
-  UInt32 i = 0;
-  for (i = 0; i < kLenNumLowSymbols; i++)
-  {
-    if (i >= numSymbols)
-      return;
-    prices[i] = a0 + RcTree_GetPrice(p->low + (posState << kLenNumLowBits), kLenNumLowBits, i, ProbPrices);
-  }
-  for (; i < kLenNumLowSymbols + kLenNumMidSymbols; i++)
-  {
-    if (i >= numSymbols)
-      return;
-    prices[i] = b0 + RcTree_GetPrice(p->mid + (posState << kLenNumMidBits), kLenNumMidBits, i - kLenNumLowSymbols, ProbPrices);
-  }
-  for (; i < numSymbols; i++)
-    prices[i] = b1 + RcTree_GetPrice(p->high, kLenNumHighBits, i - kLenNumLowSymbols - kLenNumMidSymbols, ProbPrices);
+  if (parts & kLenPricesLow)
+    RcTree_GetPrices(p->low + (posState << kLenNumLowBits), kLenNumLowBits,
+        (numSymbols < kLenNumLowSymbols ? numSymbols : kLenNumLowSymbols), a0, prices, ProbPrices);
+  if (numSymbols <= kLenNumLowSymbols)
+    return;
+  numSymbols -= kLenNumLowSymbols;
+  prices += kLenNumLowSymbols;
+  if (parts & kLenPricesMid)
+    RcTree_GetPrices(p->mid + (posState << kLenNumMidBits), kLenNumMidBits,
+        (numSymbols < kLenNumMidSymbols ? numSymbols : kLenNumMidSymbols), b0, prices, ProbPrices);
+  if (numSymbols <= kLenNumMidSymbols)
+    return;
+  if (parts & kLenPricesHigh)
+    RcTree_GetPrices(p->high, kLenNumHighBits, numSymbols - kLenNumMidSymbols, b1,
+        prices + kLenNumMidSymbols, ProbPrices);
 }
 
 static void MY_FAST_CALL LenPriceEnc_UpdateTable(CLenPriceEnc *p, UInt32 posState, UInt32 *ProbPrices)
 {
-  LenEnc_SetPrices(&p->p, posState, p->tableSize, p->prices[posState], ProbPrices);
+  LenEnc_SetPrices(&p->p, posState, p->tableSize, p->prices[posState], kLenPricesAll, ProbPrices);
   p->counters[posState] = p->tableSize;
 }
 
@@ -786,7 +901,81 @@ static void LenPriceEnc_UpdateTables(CLenPriceEnc *p, UInt32 numPosStates, UInt3
 {
   UInt32 posState;
   for (posState = 0; posState < numPosStates; posState++)
+  {
     LenPriceEnc_UpdateTable(p, posState, ProbPrices);
+    p->movedParts[posState] = 0;
+  }
+  p->priced = p->p;
+  p->movedShared = 0;
+}
+
+/* choice is in every part of every posState, choice2 in the mid and high parts,
+   high in the high parts. A shared probability is marked in movedShared, so it
+   is taken as priced only when all the tables that use it are rebuilt. */
+
+#define kLenMovedChoice 1
+#define kLenMovedChoice2 2
+#define kLenMovedHigh 4
+
+static void LenPriceEnc_CheckMoved(CLenPriceEnc *p, UInt32 symbol, UInt32 posState)
+{
+  const CLenEnc *e = &p->p;
+  const CLenEnc *priced = &p->priced;
+  UInt32 shared = 0;
+  if (PROB_MOVED(e->choice, priced->choice))
+    shared |= kLenMovedChoice;
+  if (symbol < kLenNumLowSymbols)
+  {
+    if (RcTree_Moved(e->low + (posState << kLenNumLowBits), priced->low + (posState << kLenNumLowBits),
+        kLenNumLowBits, symbol))
+      p->movedParts[posState] |= kLenPricesLow;
+  }
+  else
+  {
+    if (PROB_MOVED(e->choice2, priced->choice2))
+      shared |= kLenMovedChoice2;
+    if (symbol < kLenNumLowSymbols + kLenNumMidSymbols)
+    {
+      if (RcTree_Moved(e->mid + (posState << kLenNumMidBits), priced->mid + (posState << kLenNumMidBits),
+          kLenNumMidBits, symbol - kLenNumLowSymbols))
+        p->movedParts[posState] |= kLenPricesMid;
+    }
+    else if (RcTree_Moved(e->high, priced->high, kLenNumHighBits, symbol - kLenNumLowSymbols - kLenNumMidSymbols))
+      shared |= kLenMovedHigh;
+  }
+  p->movedShared |= shared;
+}
+
+static void LenPriceEnc_UpdateMoved(CLenPriceEnc *p, UInt32 numPosStates, UInt32 *ProbPrices)
+{
+  UInt32 posState, shared = 0;
+  if (p->movedShared & kLenMovedChoice)
+    shared = kLenPricesAll;
+  else if (p->movedShared & kLenMovedChoice2)
+    shared = kLenPricesMid | kLenPricesHigh;
+  else if (p->movedShared & kLenMovedHigh)
+    shared = kLenPricesHigh;
+  for (posState = 0; posState < numPosStates; posState++)
+  {
+    UInt32 parts = p->movedParts[posState] | shared;
+    if (parts == 0)
+      continue;
+    LenEnc_SetPrices(&p->p, posState, p->tableSize, p->prices[posState], parts, ProbPrices);
+    if (parts & kLenPricesLow)
+      memcpy(p->priced.low + (posState << kLenNumLowBits), p->p.low + (posState << kLenNumLowBits),
+          sizeof(CLzmaProb) << kLenNumLowBits);
+    if (parts & kLenPricesMid)
+      memcpy(p->priced.mid + (posState << kLenNumMidBits), p->p.mid + (posState << kLenNumMidBits),
+          sizeof(CLzmaProb) << kLenNumMidBits);
+    p->movedParts[posState] = 0;
+  }
+  if (shared & kLenPricesLow)
+    p->priced.choice = p->p.choice;
+  if (shared & kLenPricesMid)
+    p->priced.choice2 = p->p.choice2;
+  if (shared & kLenPricesHigh)
+    memcpy(p->priced.high, p->p.high, sizeof(p->p.high));
+  p->movedShared = 0;
 }
 
 static void LenEnc_Encode2(CLenPriceEnc *p, CRangeEnc *rc, UInt32 symbol, UInt32 posState, Bool updatePrice, UInt32 *ProbPrices)
@@ -808,6 +997,7 @@ static void MovePos(CLzmaEnc *p, UInt32 num)
   #endif
   if (num != 0)
   {
+    ENC_STAT(p->stats.numSkipped += num)
     p->additionalOffset += num;
     p->matchFinder.Skip(p->matchFinderObj, num);
   }
@@ -818,6 +1008,7 @@ static UInt32 ReadMatchDistances(CLzmaEnc *p, UInt32 *numDistancePairsRes)
   UInt32 lenRes = 0, numPairs;
   p->numAvail = p->matchFinder.GetNumAvailableBytes(p->matchFinderObj);
   numPairs = p->matchFinder.GetMatches(p->matchFinderObj, p->matches);
+  ENC_STAT(p->stats.numGetMatches++)
   #ifdef SHOW_STAT
   printf("\n i = %d numPairs = %d    ", ttt, numPairs / 2);
   ttt++;
@@ -837,10 +1028,7 @@ static UInt32 ReadMatchDistances(CLzmaEnc *p, UInt32 *numDistancePairsRes)
       UInt32 numAvail = p->numAvail;
       if (numAvail > LZMA_MATCH_LEN_MAX)
         numAvail = LZMA_MATCH_LEN_MAX;
-      {
-        const Byte *pby2 = pby - distance;
-        for (; lenRes < numAvail && pby[lenRes] == pby2[lenRes]; lenRes++);
-      }
+      lenRes = MatchFinder_GetMatchLen(pby - distance, pby, lenRes, numAvail);
     }
   }
   p->additionalOffset++;
@@ -892,6 +1080,8 @@ static UInt32 Backward(CLzmaEnc *p, UInt32 *backRes, UInt32 cur)
 {
   UInt32 posMem = p->opt[cur].posPrev;
   UInt32 backMem = p->opt[cur].backPrev;
+  ENC_STAT(p->stats.numOptimumParses++)
+  ENC_STAT(p->stats.optimumParseLength += cur)
   p->optimumEndIndex = cur;
   do
   {
@@ -974,7 +1164,7 @@ static UInt32 GetOptimum(CLzmaEnc *p, UInt32 position, UInt32 *backRes)
       repLens[i] = 0;
       continue;
     }
-    for (lenTest = 2; lenTest < numAvail && data[lenTest] == data2[lenTest]; lenTest++);
+    lenTest = MatchFinder_GetMatchLen(data2, data, 2, numAvail);
     repLens[i] = lenTest;
     if (lenTest > repLens[repMaxIndex])
       repMaxIndex = i;
@@ -1274,7 +1464,7 @@ static UInt32 GetOptimum(CLzmaEnc *p, UInt32 position, UInt32 *backRes)
       if (limit > numAvailFull)
         limit = numAvailFull;
 
-      for (temp = 1; temp < limit && data[temp] == data2[temp]; temp++);
+      temp = MatchFinder_GetMatchLen(data2, data, 1, limit);
       lenTest2 = temp - 1;
       if (lenTest2 >= 2)
       {
@@ -1315,7 +1505,7 @@ static UInt32 GetOptimum(CLzmaEnc *p, UInt32 position, UInt32 *backRes)
       const Byte *data2 = data - (reps[repIndex] + 1);
       if (data[0] != data2[0] || data[1] != data2[1])
         continue;
-      for (lenTest = 2; lenTest < numAvail && data[lenTest] == data2[lenTest]; lenTest++);
+      lenTest = MatchFinder_GetMatchLen(data2, data, 2, numAvail);
       while (lenEnd < cur + lenTest)
         p->opt[++lenEnd].price = kInfinityPrice;
       lenTestTemp = lenTest;
@@ -1345,7 +1535,7 @@ static UInt32 GetOptimum(CLzmaEnc *p, UInt32 position, UInt32 *backRes)
           UInt32 nextRepMatchPrice;
           if (limit > numAvailFull)
             limit = numAvailFull;
-          for (; lenTest2 < limit && data[lenTest2] == data2[lenTest2]; lenTest2++);
+          lenTest2 = MatchFinder_GetMatchLen(data2, data, lenTest2, limit);
           lenTest2 -= lenTest + 1;
           if (lenTest2 >= 2)
           {
@@ -1435,7 +1625,7 @@ static UInt32 GetOptimum(CLzmaEnc *p, UInt32 position, UInt32 *backRes)
           UInt32 nextRepMatchPrice;
           if (limit > numAvailFull)
             limit = numAvailFull;
-          for (; lenTest2 < limit && data[lenTest2] == data2[lenTest2]; lenTest2++);
+          lenTest2 = MatchFinder_GetMatchLen(data2, data, lenTest2, limit);
           lenTest2 -= lenTest + 1;
           if (lenTest2 >= 2)
           {
@@ -1515,7 +1705,7 @@ static UInt32 GetOptimumFast(CLzmaEnc *p, UInt32 *backRes)
     const Byte *data2 = data - (p->reps[i] + 1);
     if (data[0] != data2[0] || data[1] != data2[1])
       continue;
-    for (len = 2; len < numAvail && data[len] == data2[len]; len++);
+    len = MatchFinder_GetMatchLen(data2, data, 2, numAvail);
     if (len >= p->numFastBytes)
     {
       *backRes = i;
@@ -1585,7 +1775,7 @@ static UInt32 GetOptimumFast(CLzmaEnc *p, UInt32 *backRes)
     if (data[0] != data2[0] || data[1] != data2[1])
       continue;
     limit = mainLen - 1;
-    for (len = 2; len < limit && data[len] == data2[len]; len++);
+    len = MatchFinder_GetMatchLen(data2, data, 2, limit);
     if (len >= limit)
       return 1;
   }
@@ -1594,6 +1784,73 @@ static UInt32 GetOptimumFast(CLzmaEnc *p, UInt32 *backRes)
   return mainLen;
 }
 
+/* algo 2 (the fast levels): greedy, the first match found is taken and there is no look ahead.
+   After (1 << kGreedySkipShift) searches without a match, the next positions are passed as
+   literals without a search: one more every (1 << kGreedySkipShift) misses, so incompressible
+   data costs few searches. additionalOffset != 0: inside such a run */
+#define kGreedySkipShift 5
+#define kGreedySkipMax 64
+
+static UInt32 GetOptimumGreedy(CLzmaEnc *p, UInt32 *backRes)
+{
+  UInt32 numAvail, mainLen, numPairs, repIndex, repLen, skip, i;
+  const Byte *data;
+
+  *backRes = (UInt32)-1;
+  if (p->additionalOffset != 0)
+    return 1;
+  mainLen = ReadMatchDistances(p, &numPairs);
+  numAvail = p->numAvail;
+  if (numAvail < 2)
+    return 1;
+  if (numAvail > LZMA_MATCH_LEN_MAX)
+    numAvail = LZMA_MATCH_LEN_MAX;
+  data = p->matchFinder.GetPointerToCurrentPos(p->matchFinderObj) - 1;
+
+  repLen = repIndex = 0;
+  for (i = 0; i < LZMA_NUM_REPS; i++)
+  {
+    UInt32 len;
+    const Byte *data2 = data - (p->reps[i] + 1);
+    if (data[0] != data2[0] || data[1] != data2[1])
+      continue;
+    len = MatchFinder_GetMatchLen(data2, data, 2, numAvail);
+    if (len > repLen)
+    {
+      repIndex = i;
+      repLen = len;
+    }
+  }
+  if (mainLen == 2 && p->matches[numPairs - 1] >= 0x80)
+    mainLen = 1;
+
+  if (repLen >= 2 && repLen + 1 >= mainLen)
+  {
+    p->numMisses = 0;
+    *backRes = repIndex;
+    MovePos(p, repLen - 1);
+    return repLen;
+  }
+  if (mainLen >= 2)
+  {
+    p->numMisses = 0;
+    *backRes = p->matches[numPairs - 1] + LZMA_NUM_REPS;
+    MovePos(p, mainLen - 1);
+    return mainLen;
+  }
+
+  skip = p->numMisses++ >> kGreedySkipShift;
+  if (skip != 0)
+  {
+    if (skip > kGreedySkipMax)
+      skip = kGreedySkipMax;
+    if (skip > p->numAvail - 1)
+      skip = p->numAvail - 1;
+    MovePos(p, skip);
+  }
+  return 1;
+}
+
 static void WriteEndMarker(CLzmaEnc *p, UInt32 posState)
 {
   UInt32 len;
@@ -1601,7 +1858,7 @@ static void WriteEndMarker(CLzmaEnc *p, UInt32 posState)
   RangeEnc_EncodeBit(&p->rc, &p->isRep[p->state], 0);
   p->state = kMatchNextStates[p->state];
   len = LZMA_MATCH_LEN_MIN;
-  LenEnc_Encode2(&p->lenEnc, &p->rc, len - LZMA_MATCH_LEN_MIN, posState, !p->fastMode, p->ProbPrices);
+  LenEnc_Encode2(&p->lenEnc, &p->rc, len - LZMA_MATCH_LEN_MIN, posState, !p->fastMode && !p->incPrices, p->ProbPrices);
   RcTree_Encode(&p->rc, p->posSlotEncoder[GetLenToPosState(len)], kNumPosSlotBits, (1 << kNumPosSlotBits) - 1);
   RangeEnc_EncodeDirectBits(&p->rc, (((UInt32)1 << 30) - 1) >> kNumAlignBits, 30 - kNumAlignBits);
   RcTree_ReverseEncode(&p->rc, p->posAlignEncoder, kNumAlignBits, kAlignMask);
@@ -1633,44 +1890,97 @@ static SRes Flush(CLzmaEnc *p, UInt32 nowPos)
 
 static void FillAlignPrices(CLzmaEnc *p)
 {
-  UInt32 i;
-  for (i = 0; i < kAlignTableSize; i++)
-    p->alignPrices[i] = RcTree_ReverseGetPrice(p->posAlignEncoder, kNumAlignBits, i, p->ProbPrices);
+  RcTree_ReverseGetPrices(p->posAlignEncoder, kNumAlignBits, p->alignPrices, p->ProbPrices);
+  memcpy(p->pricedAlign, p->posAlignEncoder, sizeof(p->pricedAlign));
+  p->movedAlign = False;
   p->alignPriceCount = 0;
+  ENC_STAT(p->stats.numPriceUpdates++)
+}
+
+static void FillFooterPrices(CLzmaEnc *p, UInt32 posSlot)
+{
+  UInt32 footerBits = ((posSlot >> 1) - 1);
+  UInt32 base = ((2 | (posSlot & 1)) << footerBits);
+  const CLzmaProb *probs = p->posEncoders + base - posSlot - 1;
+  CLzmaProb *priced = p->pricedPos + base - posSlot - 1;
+  RcTree_ReverseGetPrices(probs, footerBits, p->footerPrices + base, p->ProbPrices);
+  memcpy(priced + 1, probs + 1, (((UInt32)1 << footerBits) - 1) * sizeof(CLzmaProb));
+}
+
+static void FillPosSlotPrices(CLzmaEnc *p, UInt32 lenToPosState)
+{
+  UInt32 *posSlotPrices = p->posSlotPrices[lenToPosState];
+  UInt32 *distancesPrices = p->distancesPrices[lenToPosState];
+  UInt32 posSlot, i;
+  RcTree_GetPrices(p->posSlotEncoder[lenToPosState], kNumPosSlotBits, p->distTableSize, 0, posSlotPrices, p->ProbPrices);
+  for (posSlot = kEndPosModelIndex; posSlot < p->distTableSize; posSlot++)
+    posSlotPrices[posSlot] += ((((posSlot >> 1) - 1) - kNumAlignBits) << kNumBitPriceShiftBits);
+
+  for (i = 0; i < kStartPosModelIndex; i++)
+    distancesPrices[i] = posSlotPrices[i];
+  for (; i < kNumFullDistances; i++)
+    distancesPrices[i] = posSlotPrices[GetPosSlot1(i)] + p->footerPrices[i];
+  memcpy(p->pricedPosSlot[lenToPosState], p->posSlotEncoder[lenToPosState], sizeof(p->pricedPosSlot[0]));
 }
 
 static void FillDistancesPrices(CLzmaEnc *p)
 {
-  UInt32 tempPrices[kNumFullDistances];
-  UInt32 i, lenToPosState;
-  for (i = kStartPosModelIndex; i < kNumFullDistances; i++)
-  {
-    UInt32 posSlot = GetPosSlot1(i);
-    UInt32 footerBits = ((posSlot >> 1) - 1);
-    UInt32 base = ((2 | (posSlot & 1)) << footerBits);
-    tempPrices[i] = RcTree_ReverseGetPrice(p->posEncoders + base - posSlot - 1, footerBits, i - base, p->ProbPrices);
-  }
+  UInt32 posSlot, lenToPosState;
+  for (posSlot = kStartPosModelIndex; posSlot < kEndPosModelIndex; posSlot++)
+    FillFooterPrices(p, posSlot);
+  for (lenToPosState = 0; lenToPosState < kNumLenToPosStates; lenToPosState++)
+    FillPosSlotPrices(p, lenToPosState);
+  p->movedPosSlots = 0;
+  p->movedPos = 0;
+  p->matchPriceCount = 0;
+  ENC_STAT(p->stats.numPriceUpdates++)
+}
 
+/* priceMode 1: rebuilds the footer and posSlot tables that moved,
+   and the distancesPrices entries that are made of them */
+static void UpdateMovedDistancesPrices(CLzmaEnc *p)
+{
+  UInt32 posSlot, lenToPosState;
+  for (posSlot = kStartPosModelIndex; posSlot < kEndPosModelIndex; posSlot++)
+    if (p->movedPos & ((UInt32)1 << posSlot))
+      FillFooterPrices(p, posSlot);
   for (lenToPosState = 0; lenToPosState < kNumLenToPosStates; lenToPosState++)
   {
-    UInt32 posSlot;
-    const CLzmaProb *encoder = p->posSlotEncoder[lenToPosState];
-    UInt32 *posSlotPrices = p->posSlotPrices[lenToPosState];
-    for (posSlot = 0; posSlot < p->distTableSize; posSlot++)
-      posSlotPrices[posSlot] = RcTree_GetPrice(encoder, kNumPosSlotBits, posSlot, p->ProbPrices);
-    for (posSlot = kEndPosModelIndex; posSlot < p->distTableSize; posSlot++)
-      posSlotPrices[posSlot] += ((((posSlot >> 1) - 1) - kNumAlignBits) << kNumBitPriceShiftBits);
-
+    if (p->movedPosSlots & ((UInt32)1 << lenToPosState))
+      FillPosSlotPrices(p, lenToPosState);
+    else if (p->movedPos != 0)
     {
+      const UInt32 *posSlotPrices = p->posSlotPrices[lenToPosState];
       UInt32 *distancesPrices = p->distancesPrices[lenToPosState];
-      UInt32 i;
-      for (i = 0; i < kStartPosModelIndex; i++)
-        distancesPrices[i] = posSlotPrices[i];
-      for (; i < kNumFullDistances; i++)
-        distancesPrices[i] = posSlotPrices[GetPosSlot1(i)] + tempPrices[i];
+      for (posSlot = kStartPosModelIndex; posSlot < kEndPosModelIndex; posSlot++)
+        if (p->movedPos & ((UInt32)1 << posSlot))
+        {
+          UInt32 footerBits = ((posSlot >> 1) - 1);
+          UInt32 base = ((2 | (posSlot & 1)) << footerBits);
+          UInt32 i;
+          for (i = base; i < base + ((UInt32)1 << footerBits); i++)
+            distancesPrices[i] = posSlotPrices[posSlot] + p->footerPrices[i];
+        }
     }
   }
-  p->matchPriceCount = 0;
+  p->movedPosSlots = 0;
+  p->movedPos = 0;
+  ENC_STAT(p->stats.numPriceUpdates++)
+}
+
+/* once per stream: LzmaEnc_Encode/MemEncode and Lzma2Enc_Encode. Not in LzmaEnc_MemPrepare,
+   which Lzma2Enc runs for every block */
+void LzmaEnc_ResetStats(CLzmaEncHandle pp)
+{
+  #ifdef LZMA_ENC_STATS
+  CLzmaEnc *p = (CLzmaEnc *)pp;
+  memset(&p->stats, 0, sizeof(p->stats));
+  memset(&p->matchFinderBase.stats, 0, sizeof(p->matchFinderBase.stats));
+  p->rc.numFlushes = 0;
+  p->rc.flushedSize = 0;
+  #else
+  pp = pp;
+  #endif
 }
 
 void LzmaEnc_Construct(CLzmaEnc *p)
@@ -1695,6 +2005,7 @@ void LzmaEnc_Construct(CLzmaEnc *p)
   LzmaEnc_InitPriceTables(p->ProbPrices);
   p->litProbs = 0;
   p->saveState.litProbs = 0;
+  LzmaEnc_ResetStats(p);
 }
 
 CLzmaEncHandle LzmaEnc_Create(ISzAlloc *alloc)
@@ -1757,6 +2068,7 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, Bool useLimits, UInt32 maxPackSize
     p->state = kLiteralNextStates[p->state];
     curByte = p->matchFinder.GetIndexByte(p->matchFinderObj, 0 - p->additionalOffset);
     LitEnc_Encode(&p->rc, p->litProbs, curByte);
+    ENC_STAT(p->stats.numLiterals++)
     p->additionalOffset--;
     nowPos32++;
   }
@@ -1766,7 +2078,9 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, Bool useLimits, UInt32 maxPackSize
   {
     UInt32 pos, len, posState;
 
-    if (p->fastMode)
+    if (p->greedyMode)
+      len = GetOptimumGreedy(p, &pos);
+    else if (p->fastMode)
       len = GetOptimumFast(p, &pos);
     else
       len = GetOptimum(p, nowPos32, &pos);
@@ -1791,6 +2105,7 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, Bool useLimits, UInt32 maxPackSize
       else
         LitEnc_EncodeMatched(&p->rc, probs, curByte, *(data - p->reps[0] - 1));
       p->state = kLiteralNextStates[p->state];
+      ENC_STAT(p->stats.numLiterals++)
     }
     else
     {
@@ -1821,22 +2136,35 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, Bool useLimits, UInt32 maxPackSize
           p->reps[0] = distance;
         }
         if (len == 1)
+        {
           p->state = kShortRepNextStates[p->state];
+          ENC_STAT(p->stats.numShortReps++)
+        }
         else
         {
-          LenEnc_Encode2(&p->repLenEnc, &p->rc, len - LZMA_MATCH_LEN_MIN, posState, !p->fastMode, p->ProbPrices);
+          LenEnc_Encode2(&p->repLenEnc, &p->rc, len - LZMA_MATCH_LEN_MIN, posState, !p->fastMode && !p->incPrices, p->ProbPrices);
+          if (p->incPrices)
+            LenPriceEnc_CheckMoved(&p->repLenEnc, len - LZMA_MATCH_LEN_MIN, posState);
           p->state = kRepNextStates[p->state];
+          ENC_STAT(p->stats.numReps++)
         }
+        ENC_STAT(p->stats.matchLength += len)
       }
       else
       {
         UInt32 posSlot;
+        UInt32 lenToPosState = GetLenToPosState(len);
         RangeEnc_EncodeBit(&p->rc, &p->isRep[p->state], 0);
         p->state = kMatchNextStates[p->state];
-        LenEnc_Encode2(&p->lenEnc, &p->rc, len - LZMA_MATCH_LEN_MIN, posState, !p->fastMode, p->ProbPrices);
+        LenEnc_Encode2(&p->lenEnc, &p->rc, len - LZMA_MATCH_LEN_MIN, posState, !p->fastMode && !p->incPrices, p->ProbPrices);
+        if (p->incPrices)
+          LenPriceEnc_CheckMoved(&p->lenEnc, len - LZMA_MATCH_LEN_MIN, posState);
         pos -= LZMA_NUM_REPS;
         GetPosSlot(pos, posSlot);
-        RcTree_Encode(&p->rc, p->posSlotEncoder[GetLenToPosState(len)], kNumPosSlotBits, posSlot);
+        RcTree_Encode(&p->rc, p->posSlotEncoder[lenToPosState], kNumPosSlotBits, posSlot);
+        if (p->incPrices && RcTree_Moved(p->posSlotEncoder[lenToPosState], p->pricedPosSlot[lenToPosState],
+            kNumPosSlotBits, posSlot))
+          p->movedPosSlots |= ((UInt32)1 << lenToPosState);
         
         if (posSlot >= kStartPosModelIndex)
         {
@@ -1845,11 +2173,18 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, Bool useLimits, UInt32 maxPackSize
           UInt32 posReduced = pos - base;
 
           if (posSlot < kEndPosModelIndex)
+          {
             RcTree_ReverseEncode(&p->rc, p->posEncoders + base - posSlot - 1, footerBits, posReduced);
+            if (p->incPrices && RcTree_ReverseMoved(p->posEncoders + base - posSlot - 1,
+                p->pricedPos + base - posSlot - 1, footerBits, posReduced))
+              p->movedPos |= ((UInt32)1 << posSlot);
+          }
           else
           {
             RangeEnc_EncodeDirectBits(&p->rc, posReduced >> kNumAlignBits, footerBits - kNumAlignBits);
             RcTree_ReverseEncode(&p->rc, p->posAlignEncoder, kNumAlignBits, posReduced & kAlignMask);
+            if (p->incPrices && RcTree_ReverseMoved(p->posAlignEncoder, p->pricedAlign, kNumAlignBits, posReduced & kAlignMask))
+              p->movedAlign = True;
             p->alignPriceCount++;
           }
         }
@@ -1858,6 +2193,8 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, Bool useLimits, UInt32 maxPackSize
         p->reps[1] = p->reps[0];
         p->reps[0] = pos;
         p->matchPriceCount++;
+        ENC_STAT(p->stats.numMatches++)
+        ENC_STAT(p->stats.matchLength += len)
       }
     }
     p->additionalOffset -= len;
@@ -1865,7 +2202,16 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, Bool useLimits, UInt32 maxPackSize
     if (p->additionalOffset == 0)
     {
       UInt32 processed;
-      if (!p->fastMode)
+      if (p->incPrices)
+      {
+        if ((p->movedPosSlots | p->movedPos) != 0)
+          UpdateMovedDistancesPrices(p);
+        if (p->movedAlign)
+          FillAlignPrices(p);
+        LenPriceEnc_UpdateMoved(&p->lenEnc, (UInt32)1 << p->pb, p->ProbPrices);
+        LenPriceEnc_UpdateMoved(&p->repLenEnc, (UInt32)1 << p->pb, p->ProbPrices);
+      }
+      else if (!p->fastMode)
       {
         if (p->matchPriceCount >= (1 << 7))
           FillDistancesPrices(p);
@@ -1900,7 +2246,7 @@ static SRes LzmaEnc_Alloc(CLzmaEnc *p, UInt32 keepWindowSize, ISzAlloc *alloc, I
   Bool btMode;
   if (!RangeEnc_Alloc(&p->rc, alloc))
     return SZ_ERROR_MEM;
-  btMode = (p->matchFinderBase.btMode != 0);
+  btMode = (p->matchFinderBase.btMode == 1);
   #ifndef _7ZIP_ST
   p->mtMode = (p->multiThread && !p->fastMode && btMode);
   #endif
@@ -1997,6 +2343,7 @@ void LzmaEnc_Init(CLzmaEnc *p)
   p->optimumEndIndex = 0;
   p->optimumCurrentIndex = 0;
   p->additionalOffset = 0;
+  p->numMisses = 0;
 
   p->pbMask = (1 << p->pb) - 1;
   p->lpMask = (1 << p->lp) - 1;
@@ -2017,6 +2364,24 @@ void LzmaEnc_InitPrices(CLzmaEnc *p)
   LenPriceEnc_UpdateTables(&p->repLenEnc, 1 << p->pb, p->ProbPrices);
 }
 
+UInt64 LzmaEnc_GetMemUsage(const CLzmaEncProps *props2, UInt32 keepWindowSize, int directInput)
+{
+  CLzmaEncProps props = *props2;
+  UInt32 beforeSize = kNumOpts;
+  UInt64 size = sizeof(CLzmaEnc) + RC_BUF_SIZE;
+  LzmaEncProps_Normalize(&props);
+  size += (UInt64)2 * ((UInt32)0x300 << (props.lc + props.lp)) * sizeof(CLzmaProb);
+  if (beforeSize + props.dictSize < keepWindowSize)
+    beforeSize = keepWindowSize - props.dictSize;
+  #ifndef _7ZIP_ST
+  if (props.numThreads > 1 && props.algo == 1 && props.btMode == 1)
+    return size + MatchFinderMt_GetMemUsage(props.dictSize, beforeSize, GetNumFastBytes(&props),
+        LZMA_MATCH_LEN_MAX, props.btMode, GetNumHashBytes(&props), directInput);
+  #endif
+  return size + MatchFinder_GetMemUsage(props.dictSize, beforeSize, GetNumFastBytes(&props),
+      LZMA_MATCH_LEN_MAX, props.btMode, GetNumHashBytes(&props), directInput);
+}
+
 static SRes LzmaEnc_AllocAndInit(CLzmaEnc *p, UInt32 keepWindowSize, ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   UInt32 i;
@@ -2034,11 +2399,42 @@ static SRes LzmaEnc_AllocAndInit(CLzmaEnc *p, UInt32 keepWindowSize, ISzAlloc *a
   return SZ_OK;
 }
 
+/* A handle can be reused for another stream or buffer: the window of the previous
+   stream encoding is freed for direct input, the caller's buffer is not freed for stream input. */
+static void LzmaEnc_SetInputStream(CLzmaEnc *p, ISeqInStream *inStream)
+{
+  if (p->matchFinderBase.directInput)
+  {
+    p->matchFinderBase.directInput = 0;
+    p->matchFinderBase.bufferBase = 0;
+  }
+  p->matchFinderBase.stream = inStream;
+}
+
+SRes LzmaEnc_GetStats(CLzmaEncHandle pp, CLzmaEncStats *stats)
+{
+  #ifdef LZMA_ENC_STATS
+  const CLzmaEnc *p = (CLzmaEnc *)pp;
+  *stats = p->stats;
+  stats->cutValue = p->matchFinderBase.cutValue;
+  stats->numChainSteps = p->matchFinderBase.stats.numChainSteps;
+  stats->numChainCuts = p->matchFinderBase.stats.numChainCuts;
+  stats->numFlushes = p->rc.numFlushes;
+  stats->flushedSize = p->rc.flushedSize;
+  return SZ_OK;
+  #else
+  pp = pp;
+  memset(stats, 0, sizeof(*stats));
+  return SZ_ERROR_UNSUPPORTED;
+  #endif
+}
+
 static SRes LzmaEnc_Prepare(CLzmaEncHandle pp, ISeqOutStream *outStream, ISeqInStream *inStream,
     ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   CLzmaEnc *p = (CLzmaEnc *)pp;
-  p->matchFinderBase.stream = inStream;
+  LzmaEnc_ResetStats(p);
+  LzmaEnc_SetInputStream(p, inStream);
   p->needInit = 1;
   p->rc.outStream = outStream;
   return LzmaEnc_AllocAndInit(p, 0, alloc, allocBig);
@@ -2049,13 +2445,18 @@ SRes LzmaEnc_PrepareForLzma2(CLzmaEncHandle pp,
     ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   CLzmaEnc *p = (CLzmaEnc *)pp;
-  p->matchFinderBase.stream = inStream;
+  LzmaEnc_SetInputStream(p, inStream);
   p->needInit = 1;
   return LzmaEnc_AllocAndInit(p, keepWindowSize, alloc, allocBig);
 }
 
-static void LzmaEnc_SetInputBuf(CLzmaEnc *p, const Byte *src, SizeT srcLen)
+static void LzmaEnc_SetInputBuf(CLzmaEnc *p, const Byte *src, SizeT srcLen, ISzAlloc *allocBig)
 {
+  if (!p->matchFinderBase.directInput)
+  {
+    allocBig->Free(allocBig, p->matchFinderBase.bufferBase);
+    p->matchFinderBase.bufferBase = 0;
+  }
   p->matchFinderBase.directInput = 1;
   p->matchFinderBase.bufferBase = (Byte *)src;
   p->matchFinderBase.directInputRem = srcLen;
@@ -2065,7 +2466,7 @@ SRes LzmaEnc_MemPrepare(CLzmaEncHandle pp, const Byte *src, SizeT srcLen,
     UInt32 keepWindowSize, ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   CLzmaEnc *p = (CLzmaEnc *)pp;
-  LzmaEnc_SetInputBuf(p, src, srcLen);
+  LzmaEnc_SetInputBuf(p, src, srcLen, allocBig);
   p->needInit = 1;
 
   return LzmaEnc_AllocAndInit(p, keepWindowSize, alloc, allocBig);
@@ -2225,8 +2626,6 @@ SRes LzmaEnc_MemEncode(CLzmaEncHandle pp, Byte *dest, SizeT *destLen, const Byte
 
   CSeqOutStreamBuf outStream;
 
-  LzmaEnc_SetInputBuf(p, src, srcLen);
-
   outStream.funcTable.Write = MyWrite;
   outStream.data = dest;
   outStream.rem = *destLen;
@@ -2235,6 +2634,7 @@ SRes LzmaEnc_MemEncode(CLzmaEncHandle pp, Byte *dest, SizeT *destLen, const Byte
   p->writeEndMark = writeEndMark;
 
   p->rc.outStream = &outStream.funcTable;
+  LzmaEnc_ResetStats(p);
   res = LzmaEnc_MemPrepare(pp, src, srcLen, 0, alloc, allocBig);
   if (res == SZ_OK)
     res = LzmaEnc_Encode2(p, progress);
@@ -2245,6 +2645,16 @@ SRes LzmaEnc_MemEncode(CLzmaEncHandle pp, Byte *dest, SizeT *destLen, const Byte
   return res;
 }
 
+SRes LzmaEnc_MemEncodeToStream(CLzmaEncHandle pp, ISeqOutStream *outStream, const Byte *src, SizeT srcLen,
+    ICompressProgress *progress, ISzAlloc *alloc, ISzAlloc *allocBig)
+{
+  CLzmaEnc *p = (CLzmaEnc *)pp;
+  p->rc.outStream = outStream;
+  LzmaEnc_ResetStats(p);
+  RINOK(LzmaEnc_MemPrepare(pp, src, srcLen, 0, alloc, allocBig));
+  return LzmaEnc_Encode2(p, progress);
+}
+
 SRes LzmaEncode(Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
     const CLzmaEncProps *props, Byte *propsEncoded, SizeT *propsSize, int writeEndMark,
     ICompressProgress *progress, ISzAlloc *alloc, ISzAlloc *allocBig)
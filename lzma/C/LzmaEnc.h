@@ -14,20 +14,25 @@ extern "C" {
 
 typedef struct _CLzmaEncProps
 {
-  int level;       /*  0 <= level <= 9 */
+  int level;       /* -2 <= level <= 9, default = 5. -1 and -2: the fast levels (algo 2, btMode 2) */
   UInt32 dictSize; /* (1 << 12) <= dictSize <= (1 << 27) for 32-bit version
                       (1 << 12) <= dictSize <= (1 << 30) for 64-bit version
                        default = (1 << 24) */
   int lc;          /* 0 <= lc <= 8, default = 3 */
   int lp;          /* 0 <= lp <= 4, default = 0 */
   int pb;          /* 0 <= pb <= 4, default = 2 */
-  int algo;        /* 0 - fast, 1 - normal, default = 1 */
+  int algo;        /* 0 - fast, 1 - normal, 2 - greedy (no prices, skips incompressible data), default = 1 */
   int fb;          /* 5 <= fb <= 273, default = 32 */
-  int btMode;      /* 0 - hashChain Mode, 1 - binTree mode - normal, default = 1 */
+  int btMode;      /* 0 - hashChain Mode, 1 - binTree mode - normal,
+                      2 - one position per 4-byte hash, no chain (numHashBytes and mc unused), default = 1 */
   int numHashBytes; /* 2, 3 or 4, default = 4 */
   UInt32 mc;        /* 1 <= mc <= (1 << 30), default = 32 */
   unsigned writeEndMark;  /* 0 - do not write EOPM, 1 - write EOPM, default = 0 */
   int numThreads;  /* 1 or 2, default = 2 */
+  int priceMode;   /* 0 - rebuild the distance and length price tables after a fixed number of symbols,
+                      1 - rebuild only the tables whose probabilities moved, default = 0 */
+  UInt64 reduceSize; /* the input size if known: the dictionary is not made bigger than needed.
+                        default = (UInt64)(Int64)-1 */
 } CLzmaEncProps;
 
 void LzmaEncProps_Init(CLzmaEncProps *p);
@@ -53,10 +58,40 @@ CLzmaEncHandle LzmaEnc_Create(ISzAlloc *alloc);
 void LzmaEnc_Destroy(CLzmaEncHandle p, ISzAlloc *alloc, ISzAlloc *allocBig);
 SRes LzmaEnc_SetProps(CLzmaEncHandle p, const CLzmaEncProps *props);
 SRes LzmaEnc_WriteProperties(CLzmaEncHandle p, Byte *properties, SizeT *size);
+/* The bytes an encoder with these props allocates (state, probs, match finder).
+   keepWindowSize: 0, or LZMA2's chunk size. directInput: the source is in memory, no window */
+UInt64 LzmaEnc_GetMemUsage(const CLzmaEncProps *props, UInt32 keepWindowSize, int directInput);
 SRes LzmaEnc_Encode(CLzmaEncHandle p, ISeqOutStream *outStream, ISeqInStream *inStream,
     ICompressProgress *progress, ISzAlloc *alloc, ISzAlloc *allocBig);
 SRes LzmaEnc_MemEncode(CLzmaEncHandle p, Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
     int writeEndMark, ICompressProgress *progress, ISzAlloc *alloc, ISzAlloc *allocBig);
+/* src is used as the match finder window directly (no copy), e.g. a memory mapped file.
+   writeEndMark is taken from props */
+SRes LzmaEnc_MemEncodeToStream(CLzmaEncHandle p, ISeqOutStream *outStream, const Byte *src, SizeT srcLen,
+    ICompressProgress *progress, ISzAlloc *alloc, ISzAlloc *allocBig);
+
+/* What the last encoding did, counted only if the library is built with LZMA_ENC_STATS */
+typedef struct
+{
+  UInt32 cutValue;           /* mc: the longest search */
+  UInt64 numGetMatches;      /* match finder searches */
+  UInt64 numSkipped;         /* positions inserted without a search (inside the chosen matches) */
+  UInt64 numChainSteps;      /* candidates compared by the searches. / numGetMatches: the average depth */
+  UInt64 numChainCuts;       /* searches stopped by cutValue */
+  UInt64 numOptimumParses;   /* GetOptimum runs that priced a parse (not the shortcuts for long matches) */
+  UInt64 optimumParseLength; /* positions priced by them */
+  UInt64 numLiterals;
+  UInt64 numMatches;
+  UInt64 numReps;            /* rep0..rep3 matches of 2 bytes or more */
+  UInt64 numShortReps;       /* rep0 of 1 byte */
+  UInt64 matchLength;        /* bytes covered by the matches and the reps */
+  UInt64 numPriceUpdates;    /* rebuilds of the distance and align price tables */
+  UInt64 numFlushes;         /* range coder buffer writes */
+  UInt64 flushedSize;        /* bytes written by them */
+} CLzmaEncStats;
+
+/* SZ_ERROR_UNSUPPORTED without LZMA_ENC_STATS */
+SRes LzmaEnc_GetStats(CLzmaEncHandle p, CLzmaEncStats *stats);
 
 /* ---------- One Call Interface ---------- */
 
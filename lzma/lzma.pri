@@ -63,6 +63,16 @@ INCLUDEPATH += $$PROJECT_SRCPATH
 DEPENDPATH += $$PROJECT_SRCPATH
 QMAKE_LFLAGS_RPATH += #will append to rpath dir
 
+#CONFIG += lzma-st #single threaded: no multithreaded match finder and no parallel lzma2 blocks
+lzma-st {
+        DEFINES += _7ZIP_ST
+} else {
+        unix: LIBS += -lpthread
+}
+
+#CONFIG += lzma-stats #count what the encoder does, see LzmaEnc_GetStats(). A bit slower
+lzma-stats: DEFINES += LZMA_ENC_STATS
+
 !lzma-buildlib {
 
         #The following may not need to change
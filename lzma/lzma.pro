@@ -1,7 +1,6 @@
 TEMPLATE = lib
 QT -= gui
 CONFIG += lzma-buildlib
-DEFINES += _7ZIP_ST
 
 include(lzma.pri)
 
@@ -10,8 +9,13 @@ HEADERS = C/LzmaLib.h \
     C/LzmaDec.h \
     C/Lzma2Enc.h \
     C/Lzma2Dec.h \
+    C/Lzma2DecMt.h \
     C/LzFind.h \
+    C/LzFindMt.h \
+    C/MtCoder.h \
+    C/Threads.h \
     C/Alloc.h \
+    C/CpuArch.h \
     C/Types.h \
     C/LzHash.h
 
@@ -21,6 +25,11 @@ SOURCES = C/LzmaLib.c \
     C/LzmaDec.c \
     C/Lzma2Enc.c \
     C/Lzma2Dec.c \
+    C/Lzma2DecMt.c \
     C/LzFind.c \
-    C/Alloc.c
+    C/LzFindMt.c \
+    C/MtCoder.c \
+    C/Threads.c \
+    C/Alloc.c \
+    C/CpuArch.c
 
@@ -0,0 +1,15 @@
+TARGET = qlzma-bench
+TEMPLATE = app
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../lzma/lzma.pri)
+
+INCLUDEPATH += .. ../..
+
+SOURCES += main.cpp \
+    ../qlzmaalloc.cpp
+
+HEADERS += \
+    ../qlzmaalloc.h
@@ -0,0 +1,567 @@
+/******************************************************************************
+	qlzma-bench: encoder and decoder throughput of the lzma library
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qlist.h>
+#include <qstringlist.h>
+#include <qvector.h>
+#if QT_VERSION >= 0x040700
+#include <qelapsedtimer.h>
+#else
+#include <qdatetime.h>
+typedef QTime QElapsedTimer;
+#endif
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "qlzmaalloc.h"
+#include "lzma/C/LzmaEnc.h"
+#include "lzma/C/LzmaDec.h"
+#include "lzma/C/Lzma2Enc.h"
+#include "lzma/C/Lzma2Dec.h"
+
+/*!
+	Every case is a corpus, a format, a level, a match finder and a dictionary size. A phase is repeated
+	until it took at least -r ms, the speeds are the bytes of all the repetitions over their time.
+	The output is one JSON document, so two runs (before and after an encoder change) can be diffed
+	by a script. The memory peaks are what the coders got from QLzmaAllocator.
+*/
+
+enum ExitCode {
+	ExitOk = 0,
+	ExitError = 1, //a case failed: the data did not come back
+	ExitUsage = 2
+};
+
+struct Corpus
+{
+	QString name;
+	QByteArray data;
+};
+
+struct MatchFinder
+{
+	const char *name;
+	int btMode;
+	int numHashBytes;
+};
+
+static const MatchFinder kMatchFinders[] = {
+	{ "bt2", 1, 2 },
+	{ "bt3", 1, 3 },
+	{ "bt4", 1, 4 },
+	{ "hc4", 0, 4 },
+	{ "hs4", 2, 4 }
+};
+
+//CLzmaEncProps.btMode
+static const char* const kFinderKinds[] = { "hc", "bt", "hs" };
+
+//CLzmaEncProps.priceMode
+static const char* const kPriceModes[] = { "periodic", "incremental" };
+
+struct Options
+{
+	Options():size(1 << 20),minTime(200),threads(1),lzma(true),lzma2(false) {}
+	int size; //of the synthetic corpora
+	int minTime; //ms per phase
+	int threads;
+	bool lzma, lzma2;
+	QList<int> levels;
+	QList<unsigned int> dictSizes; //0: the level's
+	QList<const MatchFinder*> matchFinders; //empty: the level's
+	QList<int> priceModes;
+	QStringList synthetic;
+	QStringList files;
+	QString output;
+};
+
+struct Result
+{
+	Result():packSize(0),iterations(0),setupMs(0),encodeMs(0),teardownMs(0),decodeMs(0)
+		,encodeSpeed(0),decodeSpeed(0),encodePeak(0),decodePeak(0),maxRss(0),ok(false) {}
+	qint64 packSize;
+	int iterations;
+	double setupMs, encodeMs, teardownMs, decodeMs; //per iteration
+	double encodeSpeed, decodeSpeed; //MB/s of the uncompressed data
+	qint64 encodePeak, decodePeak;
+	qint64 maxRss; //KB, the whole process so far
+	bool ok;
+};
+
+static void usage()
+{
+	fprintf(stderr,
+			"Usage: qlzma-bench [options] [file...]\n"
+			"  -l <levels>   e.g. 0-9 (default), 1,5,9 or -2--1 (the fast levels)\n"
+			"  -d <sizes>    dictionary sizes in bytes, e.g. 65536,16777216 (default: the level's)\n"
+			"  -m <finders>  bt2,bt3,bt4,hc4,hs4 (default: the level's)\n"
+			"  -c <corpora>  text,binary,random,zeros (default all, none if files are given)\n"
+			"  -s <bytes>    size of the synthetic corpora (default 1048576)\n"
+			"  -f <formats>  lzma,lzma2 (default lzma)\n"
+			"  -p <modes>    price table updates: periodic,incremental (default periodic)\n"
+			"  -T <n>        lzma: > 1 is the match finder thread, lzma2: block threads (default 1)\n"
+			"  -r <ms>       minimum time of a phase, repeated until then (default 200)\n"
+			"  -o <file>     JSON output (default stdout)\n"
+			"The files are read in whole and are corpora too.\n");
+}
+
+//xorshift, the corpora are the same on every run and every machine
+class Random
+{
+public:
+	Random(quint32 seed = 2463534242U):x(seed) {}
+	quint32 next() {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return x;
+	}
+private:
+	quint32 x;
+};
+
+static QByteArray makeCorpus(const QString &name, int size)
+{
+	QByteArray data(size, '\0');
+	char *p = data.data();
+	Random rnd;
+	if (name == "random") {
+		for (int i = 0; i < size; ++i)
+			p[i] = (char)(rnd.next() >> 24);
+	} else if (name == "text") {
+		//words with a skewed frequency, as in a natural language
+		static const char *words[] = {
+			"the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "with", "was", "on",
+			"compression", "dictionary", "match", "literal", "encoder", "decoder", "stream", "window",
+			"length", "distance", "probability", "range", "symbol", "context", "state", "price"
+		};
+		const int numWords = sizeof(words) / sizeof(words[0]);
+		int i = 0, column = 0;
+		while (i < size) {
+			quint32 r = rnd.next();
+			const char *w = words[(r % numWords) * ((r >> 8) % numWords) / numWords];
+			for (; *w && i < size; ++w, ++i, ++column)
+				p[i] = *w;
+			if (i < size)
+				p[i++] = column > 72 ? '\n' : ' ';
+			if (column > 72)
+				column = 0;
+		}
+	} else if (name == "binary") {
+		//records of counters, small integers and pointers, as in an executable or a database
+		int i = 0;
+		quint32 counter = 0x10000;
+		while (i + 16 <= size) {
+			quint32 r = rnd.next();
+			quint32 fields[4] = { counter, r & 0xFF, 0x08040000 + ((r >> 8) & 0xFFF) * 4, (r >> 20) < 64 ? r : 0 };
+			for (int k = 0; k < 4; ++k, i += 4) {
+				p[i] = (char)fields[k];
+				p[i + 1] = (char)(fields[k] >> 8);
+				p[i + 2] = (char)(fields[k] >> 16);
+				p[i + 3] = (char)(fields[k] >> 24);
+			}
+			counter += 1 + (r >> 30);
+		}
+	} //zeros: as is
+	return data;
+}
+
+//setup and teardown are far below 1 ms, use the finer clock if there is one
+static double elapsedMs(const QElapsedTimer &timer)
+{
+#if QT_VERSION >= 0x040800
+	return (double)timer.nsecsElapsed() / 1000000.0;
+#else
+	return (double)timer.elapsed();
+#endif
+}
+
+static qint64 maxRss()
+{
+#ifdef Q_OS_UNIX
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef Q_OS_MAC
+	return usage.ru_maxrss / 1024; //bytes
+#else
+	return usage.ru_maxrss;
+#endif //Q_OS_MAC
+#else
+	return 0;
+#endif //Q_OS_UNIX
+}
+
+class MemInStream : public ISeqInStream
+{
+public:
+	MemInStream(const QByteArray &data):data(data),pos(0) { Read = &MemInStream::read; }
+private:
+	static SRes read(void *p, void *buf, size_t *size) {
+		MemInStream *s = static_cast<MemInStream*>((ISeqInStream*)p);
+		size_t n = qMin(*size, (size_t)(s->data.size() - s->pos));
+		memcpy(buf, s->data.constData() + s->pos, n);
+		s->pos += n;
+		*size = n;
+		return SZ_OK;
+	}
+	const QByteArray &data;
+	size_t pos;
+};
+
+class MemOutStream : public ISeqOutStream
+{
+public:
+	MemOutStream(QByteArray *data):data(data),pos(0) { Write = &MemOutStream::write; }
+	size_t size() const { return pos; }
+private:
+	static size_t write(void *p, const void *buf, size_t size) {
+		MemOutStream *s = static_cast<MemOutStream*>((ISeqOutStream*)p);
+		if ((size_t)s->data->size() < s->pos + size)
+			size = s->data->size() - s->pos;
+		memcpy(s->data->data() + s->pos, buf, size);
+		s->pos += size;
+		return size;
+	}
+	QByteArray *data;
+	size_t pos;
+};
+
+static ISzAlloc* smallAlloc() { return QLzmaAllocator::get(QLzmaAllocator::Small); }
+static ISzAlloc* bigAlloc() { return QLzmaAllocator::get(QLzmaAllocator::Big); }
+
+/*!
+	One encode and one decode. props: level, dictSize, btMode and numHashBytes, numThreads.
+	The times are added to r, the packed data is left in packed
+*/
+static bool runOnce(const QByteArray &data, bool lzma2, const CLzmaEncProps &props, int threads
+		, QByteArray *packed, QByteArray *unpacked, Result *r, QLzmaAllocCounter *encodeMem, QLzmaAllocCounter *decodeMem)
+{
+	QElapsedTimer timer;
+	SizeT packSize = packed->size();
+	Byte header[LZMA_PROPS_SIZE];
+	SRes res;
+	if (lzma2) {
+		CLzma2EncProps p;
+		Lzma2EncProps_Init(&p);
+		p.lzmaProps = props;
+		p.lzmaProps.numThreads = 1;
+		p.numBlockThreads = threads;
+		QLzmaAllocStatsScope scope(encodeMem);
+		timer.start();
+		CLzma2EncHandle enc = Lzma2Enc_Create(smallAlloc(), bigAlloc());
+		if (!enc)
+			return false;
+		res = Lzma2Enc_SetProps(enc, &p);
+		header[0] = Lzma2Enc_WriteProperties(enc);
+		r->setupMs += elapsedMs(timer);
+		timer.start();
+		MemInStream in(data);
+		MemOutStream out(packed);
+		if (res == SZ_OK)
+			res = Lzma2Enc_Encode(enc, &out, &in, 0);
+		packSize = out.size();
+		r->encodeMs += elapsedMs(timer);
+		timer.start();
+		Lzma2Enc_Destroy(enc);
+		r->teardownMs += elapsedMs(timer);
+	} else {
+		QLzmaAllocStatsScope scope(encodeMem);
+		timer.start();
+		CLzmaEncHandle enc = LzmaEnc_Create(smallAlloc());
+		if (!enc)
+			return false;
+		SizeT propsSize = LZMA_PROPS_SIZE;
+		res = LzmaEnc_SetProps(enc, &props);
+		if (res == SZ_OK)
+			res = LzmaEnc_WriteProperties(enc, header, &propsSize);
+		r->setupMs += elapsedMs(timer);
+		timer.start();
+		if (res == SZ_OK)
+			res = LzmaEnc_MemEncode(enc, (Byte*)packed->data(), &packSize, (const Byte*)data.constData(), data.size()
+					, 0, 0, smallAlloc(), bigAlloc());
+		r->encodeMs += elapsedMs(timer);
+		timer.start();
+		LzmaEnc_Destroy(enc, smallAlloc(), bigAlloc());
+		r->teardownMs += elapsedMs(timer);
+	}
+	if (res != SZ_OK)
+		return false;
+	r->packSize = packSize;
+
+	QLzmaAllocStatsScope scope(decodeMem);
+	SizeT unpackSize = unpacked->size();
+	SizeT srcLen = packSize;
+	ELzmaStatus status;
+	timer.start();
+	if (lzma2)
+		res = Lzma2Decode((Byte*)unpacked->data(), &unpackSize, (const Byte*)packed->constData(), &srcLen
+				, header[0], LZMA_FINISH_END, &status, smallAlloc());
+	else
+		res = LzmaDecode((Byte*)unpacked->data(), &unpackSize, (const Byte*)packed->constData(), &srcLen
+				, header, LZMA_PROPS_SIZE, LZMA_FINISH_ANY, &status, smallAlloc());
+	r->decodeMs += elapsedMs(timer);
+	return res == SZ_OK && unpackSize == (SizeT)data.size() && !memcmp(unpacked->constData(), data.constData(), data.size());
+}
+
+static Result runCase(const QByteArray &data, bool lzma2, const CLzmaEncProps &props, const Options &opt)
+{
+	Result r;
+	QByteArray packed(data.size() + data.size() / 2 + (1 << 16), '\0');
+	QByteArray unpacked(data.size(), '\0');
+	QLzmaAllocCounter encodeMem, decodeMem;
+	double total = 0;
+	r.ok = true;
+	while (r.ok && (r.iterations == 0 || total < opt.minTime)) {
+		r.ok = runOnce(data, lzma2, props, opt.threads, &packed, &unpacked, &r, &encodeMem, &decodeMem);
+		++r.iterations;
+		r.encodePeak = qMax(r.encodePeak, encodeMem.stats().peakBytes);
+		r.decodePeak = qMax(r.decodePeak, decodeMem.stats().peakBytes);
+		total = r.setupMs + r.encodeMs + r.teardownMs;
+		total = qMax(total, r.decodeMs);
+	}
+	const double mb = (double)data.size() * r.iterations / (1024.0 * 1024.0);
+	//a phase shorter than the timer resolution counts as 1 ms
+	r.encodeSpeed = mb / (qMax(1.0, r.setupMs + r.encodeMs + r.teardownMs) / 1000.0);
+	r.decodeSpeed = mb / (qMax(1.0, r.decodeMs) / 1000.0);
+	r.setupMs /= r.iterations;
+	r.encodeMs /= r.iterations;
+	r.teardownMs /= r.iterations;
+	r.decodeMs /= r.iterations;
+	r.maxRss = maxRss();
+	return r;
+}
+
+static QByteArray jsonString(const QString &s)
+{
+	QByteArray utf8 = s.toUtf8();
+	QByteArray out = "\"";
+	for (int i = 0; i < utf8.size(); ++i) {
+		char c = utf8.at(i);
+		if (c == '"' || c == '\\')
+			out += '\\';
+		if ((uchar)c < 0x20)
+			out += QString().sprintf("\\u%04x", (uchar)c).toLatin1();
+		else
+			out += c;
+	}
+	return out + "\"";
+}
+
+static bool parseList(const char *arg, QList<int> *values)
+{
+	QStringList items = QString(arg).split(',', QString::SkipEmptyParts);
+	for (int i = 0; i < items.size(); ++i) {
+		//a leading - is a sign, e.g. -2--1
+		const QString &item = items.at(i);
+		int dash = item.indexOf('-', 1);
+		bool ok1 = false, ok2 = false;
+		int from = item.left(dash).toInt(&ok1);
+		int to = dash > 0 ? item.mid(dash + 1).toInt(&ok2) : (ok2 = ok1, from);
+		if (!ok1 || !ok2 || from > to)
+			return false;
+		for (int v = from; v <= to; ++v)
+			values->append(v);
+	}
+	return !values->isEmpty();
+}
+
+int main(int argc, char *argv[])
+{
+	Options opt;
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		if (arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0' && strchr("ldmcsfpTro", arg[1]) && i + 1 < argc) {
+			const char *value = argv[++i];
+			bool ok = true;
+			switch (arg[1]) {
+			case 'l':
+				ok = parseList(value, &opt.levels);
+				for (int k = 0; k < opt.levels.size(); ++k)
+					ok = ok && opt.levels.at(k) >= -2 && opt.levels.at(k) <= 9;
+				break;
+			case 'd': {
+				QStringList sizes = QString(value).split(',', QString::SkipEmptyParts);
+				for (int k = 0; k < sizes.size(); ++k) {
+					unsigned int size = sizes.at(k).toUInt(&ok);
+					ok = ok && size >= (1 << 12);
+					if (!ok)
+						break;
+					opt.dictSizes.append(size);
+				}
+				break;
+			}
+			case 'm': {
+				QStringList names = QString(value).split(',', QString::SkipEmptyParts);
+				for (int k = 0; k < names.size() && ok; ++k) {
+					ok = false;
+					for (size_t f = 0; f < sizeof(kMatchFinders) / sizeof(kMatchFinders[0]); ++f) {
+						if (names.at(k) == kMatchFinders[f].name) {
+							opt.matchFinders.append(&kMatchFinders[f]);
+							ok = true;
+						}
+					}
+				}
+				break;
+			}
+			case 'c':
+				opt.synthetic = QString(value).split(',', QString::SkipEmptyParts);
+				for (int k = 0; k < opt.synthetic.size(); ++k)
+					ok = ok && QString("text,binary,random,zeros").split(',').contains(opt.synthetic.at(k));
+				break;
+			case 's':
+				opt.size = atoi(value);
+				ok = opt.size > 0;
+				break;
+			case 'f': {
+				QStringList formats = QString(value).split(',', QString::SkipEmptyParts);
+				opt.lzma = formats.contains("lzma");
+				opt.lzma2 = formats.contains("lzma2");
+				ok = (opt.lzma || opt.lzma2) && formats.size() == (int)opt.lzma + (int)opt.lzma2;
+				break;
+			}
+			case 'p': {
+				QStringList modes = QString(value).split(',', QString::SkipEmptyParts);
+				for (int k = 0; k < modes.size() && ok; ++k) {
+					ok = false;
+					for (size_t m = 0; m < sizeof(kPriceModes) / sizeof(kPriceModes[0]); ++m) {
+						if (modes.at(k) == kPriceModes[m]) {
+							opt.priceModes.append(m);
+							ok = true;
+						}
+					}
+				}
+				break;
+			}
+			case 'T':
+				opt.threads = qMax(1, atoi(value));
+				break;
+			case 'r':
+				opt.minTime = qMax(0, atoi(value));
+				break;
+			case 'o':
+				opt.output = QFile::decodeName(value);
+				break;
+			}
+			if (!ok) {
+				fprintf(stderr, "qlzma-bench: bad value of %s: %s\n", arg, value);
+				return ExitUsage;
+			}
+		} else if (arg[0] == '-') {
+			usage();
+			return ExitUsage;
+		} else {
+			opt.files.append(QFile::decodeName(arg));
+		}
+	}
+	if (opt.levels.isEmpty())
+		parseList("0-9", &opt.levels);
+	if (opt.dictSizes.isEmpty())
+		opt.dictSizes.append(0);
+	if (opt.priceModes.isEmpty())
+		opt.priceModes.append(0);
+	if (opt.synthetic.isEmpty() && opt.files.isEmpty())
+		opt.synthetic = QString("text,binary,random,zeros").split(',');
+
+	QList<Corpus> corpora;
+	for (int i = 0; i < opt.synthetic.size(); ++i) {
+		Corpus c;
+		c.name = opt.synthetic.at(i);
+		c.data = makeCorpus(c.name, opt.size);
+		corpora.append(c);
+	}
+	for (int i = 0; i < opt.files.size(); ++i) {
+		QFile f(opt.files.at(i));
+		if (!f.open(QIODevice::ReadOnly)) {
+			fprintf(stderr, "qlzma-bench: %s: %s\n", qPrintable(opt.files.at(i)), qPrintable(f.errorString()));
+			return ExitError;
+		}
+		Corpus c;
+		c.name = opt.files.at(i);
+		c.data = f.readAll();
+		corpora.append(c);
+	}
+
+	FILE *out = stdout;
+	if (!opt.output.isEmpty() && !(out = fopen(QFile::encodeName(opt.output).constData(), "w"))) {
+		fprintf(stderr, "qlzma-bench: can not write %s\n", qPrintable(opt.output));
+		return ExitError;
+	}
+	int ret = ExitOk;
+	fprintf(out, "{\n  \"tool\": \"qlzma-bench\",\n  \"threads\": %d,\n  \"min_time_ms\": %d,\n  \"results\": [", opt.threads, opt.minTime);
+	bool first = true;
+	QList<const MatchFinder*> levelFinder;
+	levelFinder.append(0);
+	for (int c = 0; c < corpora.size(); ++c) {
+		const Corpus &corpus = corpora.at(c);
+		for (int f = 0; f < 2; ++f) {
+			bool lzma2 = f == 1;
+			if ((lzma2 && !opt.lzma2) || (!lzma2 && !opt.lzma))
+				continue;
+			for (int l = 0; l < opt.levels.size(); ++l) {
+				const QList<const MatchFinder*> &finders = opt.matchFinders.isEmpty() ? levelFinder : opt.matchFinders;
+				for (int m = 0; m < finders.size(); ++m) {
+					for (int d = 0; d < opt.dictSizes.size(); ++d) {
+						for (int pm = 0; pm < opt.priceModes.size(); ++pm) {
+							CLzmaEncProps props;
+							LzmaEncProps_Init(&props);
+							props.level = opt.levels.at(l);
+							props.dictSize = opt.dictSizes.at(d);
+							props.numThreads = opt.threads > 1 ? 2 : 1;
+							props.reduceSize = corpus.data.size(); //as QLzma does
+							props.priceMode = opt.priceModes.at(pm);
+							if (finders.at(m)) {
+								props.btMode = finders.at(m)->btMode;
+								props.numHashBytes = finders.at(m)->numHashBytes;
+							}
+							LzmaEncProps_Normalize(&props);
+							fprintf(stderr, "%s %s level %d dict %u %s%d %s\n", qPrintable(corpus.name), lzma2 ? "lzma2" : "lzma", props.level
+									, props.dictSize, kFinderKinds[props.btMode], props.numHashBytes, kPriceModes[props.priceMode]);
+							Result r = runCase(corpus.data, lzma2, props, opt);
+							if (!r.ok)
+								ret = ExitError;
+							fprintf(out, "%s\n    {\"corpus\": %s, \"format\": \"%s\", \"level\": %d, \"dict_size\": %u, \"match_finder\": \"%s%d\", \"price_mode\": \"%s\""
+									", \"input_bytes\": %d, \"packed_bytes\": %lld, \"ratio\": %.4f, \"encode_mbps\": %.3f, \"decode_mbps\": %.3f"
+									", \"phases_ms\": {\"setup\": %.3f, \"encode\": %.3f, \"teardown\": %.3f, \"decode\": %.3f}"
+									", \"encode_peak_bytes\": %lld, \"decode_peak_bytes\": %lld, \"max_rss_kb\": %lld, \"iterations\": %d, \"ok\": %s}"
+									, first ? "" : ",", jsonString(corpus.name).constData(), lzma2 ? "lzma2" : "lzma", props.level, props.dictSize
+									, kFinderKinds[props.btMode], props.numHashBytes, kPriceModes[props.priceMode], corpus.data.size(), (long long)r.packSize
+									, corpus.data.isEmpty() ? 0.0 : (double)r.packSize / corpus.data.size(), r.encodeSpeed, r.decodeSpeed
+									, r.setupMs, r.encodeMs, r.teardownMs, r.decodeMs, (long long)r.encodePeak, (long long)r.decodePeak
+									, (long long)r.maxRss, r.iterations, r.ok ? "true" : "false");
+							fflush(out);
+							first = false;
+						}
+					}
+				}
+			}
+		}
+	}
+	fprintf(out, "\n  ]\n}\n");
+	if (out != stdout)
+		fclose(out);
+	return ret;
+}
@@ -0,0 +1,34 @@
+TARGET = qlzma-cli
+TEMPLATE = app
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+#qlzma.cpp without the progress dialog
+DEFINES += QLZMA_NO_GUI
+
+include(../../lzma/lzma.pri)
+
+INCLUDEPATH += .. ../..
+
+SOURCES += main.cpp \
+    ../qlzma.cpp \
+    ../qlzmastream.cpp \
+    ../qlzmaindex.cpp \
+    ../qlzmabatch.cpp \
+    ../qlzmaencoder.cpp \
+    ../qlzmaalloc.cpp \
+    ../qlzmaplan.cpp \
+    ../qtar.cpp \
+    ../utils/convert.cpp
+
+HEADERS += \
+    ../qlzma.h \
+    ../qlzmastream.h \
+    ../qlzmaindex.h \
+    ../qlzmabatch.h \
+    ../qlzmaencoder.h \
+    ../qlzmaalloc.h \
+    ../qlzmaplan.h \
+    ../qtar.h \
+    ../utils/convert.h \
+    ../msgdef.h
@@ -0,0 +1,367 @@
+/******************************************************************************
+	qlzma-cli: command line front-end of QLzma without gui
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qstringlist.h>
+#ifdef Q_OS_WIN
+#include <io.h>
+#include <fcntl.h>
+#endif //Q_OS_WIN
+
+#include "qlzma.h"
+#include "qlzmabatch.h"
+#include "lzma/C/Types.h"
+
+/*!
+	No QCoreApplication: nothing here needs an event loop, so the startup is only
+	the process and QtCore loading. compressStream()/extractStream() run in this thread.
+*/
+
+enum ExitCode {
+	ExitOk = 0,
+	ExitError = 1, //I/O error, corrupted data...
+	ExitUsage = 2
+};
+
+//test: decode and drop the data
+class NullDevice : public QIODevice
+{
+protected:
+	qint64 readData(char *, qint64) { return -1; }
+	qint64 writeData(const char *, qint64 len) { return len; }
+};
+
+static const char *errorString(int res)
+{
+	switch (res) {
+	case SZ_OK: return "ok";
+	case SZ_ERROR_DATA: return "data error";
+	case SZ_ERROR_MEM: return "out of memory";
+	case SZ_ERROR_UNSUPPORTED: return "unsupported format";
+	case SZ_ERROR_PARAM: return "bad parameter";
+	case SZ_ERROR_INPUT_EOF: return "unexpected end of input";
+	case SZ_ERROR_READ: return "read error";
+	case SZ_ERROR_WRITE: return "write error";
+	case SZ_ERROR_PROGRESS: return "canceled";
+	default: return "error";
+	}
+}
+
+static void usage()
+{
+	fprintf(stderr,
+			"Usage: qlzma-cli <command> [options] [file...]\n"
+			"Commands:\n"
+			"  c, compress   compress file to file.lzma\n"
+			"  x, extract    extract file.lzma to file\n"
+			"  t, test       decode and discard the data\n"
+			"  l, list       show the header of each file\n"
+			"Options:\n"
+			"  -0..-9        compression level (default 7)\n"
+			"  --fast        level -1: greedy, for speed over ratio\n"
+			"  --fastest     level -2: as --fast with a 64 KB dictionary\n"
+			"  --lzma2       write lzma2 instead of lzma86\n"
+			"  --index       lzma2: append the seek index\n"
+			"  --tar         compress: a directory to dir.tar.lzma as one solid stream\n"
+			"                extract: unpack the tar into -o dir (default .)\n"
+			"  -b <bytes>    lzma2 block size\n"
+			"  -T <n>        threads, 0 = all cores (default)\n"
+			"  -M <MB>       encoder memory limit: smaller dictionary and fewer threads if needed\n"
+			"  -o <file>     output file, - is stdout\n"
+			"  -c            write to stdout\n"
+			"  -f            overwrite existing output files\n"
+			"  --large-pages use reserved huge pages (MAP_HUGETLB) for the big buffers\n"
+			"  --mem         print the memory used for each file\n"
+			"  --stats       print what the encoder did for each file (lzma library built with lzma-stats)\n"
+			"No file or - reads stdin and writes stdout.\n"
+			"Several files or a directory are compressed in parallel, one file per core.\n"
+			"The files in a directory are compressed to file.lzma, existing ones are replaced.\n"
+			"Exit status: 0 ok, 1 error, 2 bad usage\n");
+}
+
+static void printMemory(const QString &name, const QLzmaAllocStats &stats)
+{
+	fprintf(stderr, "%s: peak %.1f MB, %llu bytes in %llu allocations\n", qPrintable(name)
+			, stats.peakBytes / 1048576.0, (unsigned long long)stats.allocatedBytes, (unsigned long long)stats.allocations);
+}
+
+static void printEncoderStats(const QString &name, const CLzmaEncStats &s)
+{
+	const double searches = qMax<double>(1, s.numGetMatches);
+	const double parses = qMax<double>(1, s.numOptimumParses);
+	const double matches = qMax<double>(1, s.numMatches + s.numReps);
+	fprintf(stderr, "%s: %llu searches, depth %.2f of %u, %.2f%% cut, %llu skipped\n", qPrintable(name)
+			, (unsigned long long)s.numGetMatches, s.numChainSteps / searches, s.cutValue
+			, 100.0 * s.numChainCuts / searches, (unsigned long long)s.numSkipped);
+	fprintf(stderr, "%s: %llu parses of %.1f bytes, %llu price updates\n", qPrintable(name)
+			, (unsigned long long)s.numOptimumParses, s.optimumParseLength / parses, (unsigned long long)s.numPriceUpdates);
+	fprintf(stderr, "%s: %llu literals, %llu matches, %llu reps, %llu short reps, %.1f bytes per match\n", qPrintable(name)
+			, (unsigned long long)s.numLiterals, (unsigned long long)s.numMatches, (unsigned long long)s.numReps
+			, (unsigned long long)s.numShortReps, s.matchLength / matches);
+	fprintf(stderr, "%s: %llu bytes in %llu writes\n", qPrintable(name)
+			, (unsigned long long)s.flushedSize, (unsigned long long)s.numFlushes);
+}
+
+static bool openStd(QFile *f, bool input)
+{
+#ifdef Q_OS_WIN
+	_setmode(input ? 0 : 1, _O_BINARY);
+#endif //Q_OS_WIN
+	return f->open(input ? 0 : 1, (input ? QIODevice::ReadOnly : QIODevice::WriteOnly) | QIODevice::Unbuffered);
+}
+
+struct Options
+{
+	Options():level(7),overwrite(false),toStdout(false),tar(false),mem(false),stats(false) {}
+	int level;
+	bool overwrite;
+	bool toStdout;
+	bool tar;
+	bool mem;
+	bool stats;
+	QString output;
+};
+
+static int run(QLzma *lzma, const QString &cmd, const QString &file, const Options &opt)
+{
+	bool useStdin = file == "-";
+	QString name = useStdin ? QString("(stdin)") : file;
+	bool compress = cmd == "compress";
+	if (compress && opt.tar && useStdin) {
+		fprintf(stderr, "qlzma-cli: --tar needs a directory\n");
+		return ExitError;
+	}
+	QFile in;
+	if (compress && opt.tar) {
+		//the directory is read by compressDirectory()
+	} else if (useStdin) {
+		openStd(&in, true);
+	} else {
+		in.setFileName(file);
+		if (!in.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+			fprintf(stderr, "qlzma-cli: %s: %s\n", qPrintable(name), qPrintable(in.errorString()));
+			return ExitError;
+		}
+	}
+
+	if (cmd == "list") {
+		QLzma::Format format;
+		qint64 unpackSize;
+		quint32 dictSize;
+		if (!QLzma::readHeader(&in, &format, &unpackSize, &dictSize)) {
+			fprintf(stderr, "qlzma-cli: %s: not an lzma file\n", qPrintable(name));
+			return ExitError;
+		}
+		qint64 packSize = useStdin ? -1 : in.size();
+		printf("%-6s %10u %14lld %14lld %7s  %s\n", format == QLzma::Lzma2 ? "lzma2" : "lzma86", dictSize
+			   , packSize, unpackSize
+			   , packSize >= 0 && unpackSize > 0 ? qPrintable(QString("%1%").arg(100.0 * packSize / unpackSize, 0, 'f', 1)) : "-"
+			   , qPrintable(name));
+		return ExitOk;
+	}
+	if (cmd == "test") {
+		NullDevice out;
+		out.open(QIODevice::WriteOnly);
+		int res = lzma->extractStream(&in, &out);
+		if (res != SZ_OK) {
+			fprintf(stderr, "qlzma-cli: %s: %s\n", qPrintable(name), errorString(res));
+			return ExitError;
+		}
+		return ExitOk;
+	}
+
+	if (!compress && opt.tar) {
+		QString dir = opt.output.isEmpty() ? QString(".") : opt.output;
+		int res = lzma->extractDirectory(&in, dir);
+		if (res != SZ_OK) {
+			fprintf(stderr, "qlzma-cli: %s: %s\n", qPrintable(name), errorString(res));
+			return ExitError;
+		}
+		return ExitOk;
+	}
+
+	QString outName = opt.output;
+	if (outName.isEmpty()) {
+		if (useStdin || opt.toStdout) {
+			outName = "-";
+		} else if (compress && opt.tar) {
+			QString dir = file;
+			while (dir.length() > 1 && dir.endsWith('/'))
+				dir.chop(1);
+			outName = dir + ".tar.lzma";
+		} else if (compress) {
+			outName = file + ".lzma";
+		} else if (file.endsWith(".lzma")) {
+			outName = file.left(file.length() - 5);
+		} else {
+			fprintf(stderr, "qlzma-cli: %s: unknown suffix, use -o\n", qPrintable(name));
+			return ExitError;
+		}
+	}
+	QFile out;
+	if (outName == "-") {
+		openStd(&out, false);
+	} else {
+		out.setFileName(outName);
+		if (!opt.overwrite && out.exists()) {
+			fprintf(stderr, "qlzma-cli: %s already exists, use -f\n", qPrintable(outName));
+			return ExitError;
+		}
+		//ReadWrite: extractStream() may decode into the mapped file
+		if (!out.open((compress ? QIODevice::WriteOnly : QIODevice::ReadWrite) | QIODevice::Truncate | QIODevice::Unbuffered)) {
+			fprintf(stderr, "qlzma-cli: %s: %s\n", qPrintable(outName), qPrintable(out.errorString()));
+			return ExitError;
+		}
+	}
+	int res;
+	if (compress && opt.tar)
+		res = lzma->compressDirectory(file, &out, opt.level);
+	else if (compress)
+		res = lzma->compressStream(&in, &out, useStdin ? -1 : in.size(), opt.level);
+	else
+		res = lzma->extractStream(&in, &out);
+	if (res != SZ_OK) {
+		fprintf(stderr, "qlzma-cli: %s: %s\n", qPrintable(name), errorString(res));
+		if (outName != "-")
+			out.remove();
+		return ExitError;
+	}
+	if (opt.mem)
+		printMemory(name, lzma->allocStats());
+	if (opt.stats && compress) {
+		CLzmaEncStats stats;
+		if (lzma->encoderStats(&stats))
+			printEncoderStats(name, stats);
+		else
+			fprintf(stderr, "qlzma-cli: the lzma library does not count, build it with CONFIG += lzma-stats\n");
+	}
+	return ExitOk;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		usage();
+		return ExitUsage;
+	}
+	QString cmd = argv[1];
+	if (cmd == "c")
+		cmd = "compress";
+	else if (cmd == "x")
+		cmd = "extract";
+	else if (cmd == "t")
+		cmd = "test";
+	else if (cmd == "l")
+		cmd = "list";
+	if (cmd != "compress" && cmd != "extract" && cmd != "test" && cmd != "list") {
+		usage();
+		return ExitUsage;
+	}
+
+	QLzma lzma;
+	Options opt;
+	QStringList files;
+	for (int i = 2; i < argc; ++i) {
+		const char *arg = argv[i];
+		if (arg[0] == '-' && arg[1] >= '0' && arg[1] <= '9' && arg[2] == '\0') {
+			opt.level = arg[1] - '0';
+		} else if (!strcmp(arg, "--fast")) {
+			opt.level = -1;
+		} else if (!strcmp(arg, "--fastest")) {
+			opt.level = -2;
+		} else if (!strcmp(arg, "--lzma2")) {
+			lzma.setFormat(QLzma::Lzma2);
+		} else if (!strcmp(arg, "--tar")) {
+			opt.tar = true;
+		} else if (!strcmp(arg, "--index")) {
+			lzma.setSeekIndex(true);
+		} else if (!strcmp(arg, "-c")) {
+			opt.toStdout = true;
+		} else if (!strcmp(arg, "-f")) {
+			opt.overwrite = true;
+		} else if (!strcmp(arg, "--large-pages")) {
+			QLzmaAllocator::enableLargePages();
+		} else if (!strcmp(arg, "--mem")) {
+			opt.mem = true;
+		} else if (!strcmp(arg, "--stats")) {
+			opt.stats = true;
+		} else if ((!strcmp(arg, "-b") || !strcmp(arg, "-T") || !strcmp(arg, "-M") || !strcmp(arg, "-o")) && i + 1 < argc) {
+			const char *value = argv[++i];
+			if (arg[1] == 'b')
+				lzma.setBlockSize(strtoul(value, 0, 0));
+			else if (arg[1] == 'M')
+				lzma.setMemoryLimit((quint64)strtoul(value, 0, 0) << 20);
+			else if (arg[1] == 'T')
+				lzma.setThreads(atoi(value));
+			else
+				opt.output = QFile::decodeName(value);
+		} else if (arg[0] == '-' && arg[1] != '\0') {
+			fprintf(stderr, "qlzma-cli: unknown option %s\n", arg);
+			usage();
+			return ExitUsage;
+		} else {
+			files.append(QFile::decodeName(arg));
+		}
+	}
+	if (files.isEmpty())
+		files.append("-");
+	if (!opt.output.isEmpty() && files.size() > 1) {
+		fprintf(stderr, "qlzma-cli: -o needs a single input\n");
+		return ExitUsage;
+	}
+
+	int ret = ExitOk;
+	if (cmd == "compress" && !opt.tar && !opt.toStdout && opt.output.isEmpty() && !files.contains("-")
+			&& (files.size() > 1 || QFileInfo(files.first()).isDir())) {
+		QLzmaBatch batch;
+		batch.setLevel(opt.level);
+		batch.setFormat(lzma.format());
+		batch.setBlockSize(lzma.blockSize());
+		batch.setSeekIndex(lzma.seekIndex());
+		batch.setThreads(lzma.threads());
+		batch.setMemoryLimit(lzma.memoryLimit());
+		for (int i = 0; i < files.size(); ++i) {
+			const QString &file = files.at(i);
+			if (QFileInfo(file).isDir()) {
+				batch.addDirectory(file);
+			} else if (!opt.overwrite && QFile::exists(file + ".lzma")) {
+				fprintf(stderr, "qlzma-cli: %s.lzma already exists, use -f\n", qPrintable(file));
+				ret = ExitError;
+			} else {
+				batch.addFile(file);
+			}
+		}
+		batch.start();
+		if (!batch.wait())
+			ret = ExitError;
+		//the workers share the encoders, only the sum is meaningful
+		if (opt.mem)
+			printMemory("total", QLzmaAllocator::globalStats());
+		return ret;
+	}
+	for (int i = 0; i < files.size(); ++i) {
+		if (run(&lzma, cmd, files.at(i), opt) != ExitOk)
+			ret = ExitError;
+	}
+	return ret;
+}
@@ -9,9 +9,12 @@ int main(int argc, char *argv[])
 {
 	QApplication a(argc, argv);
 
-	QLzma lzma;
-	lzma.setUncompressedFile(argv[1]);
-	lzma.compress();
+	QLzma lzma(argv[1]);
+	QObject::connect(&lzma, SIGNAL(canceled()), &a, SLOT(quit()));
+	if (QString(argv[1]).endsWith(".lzma"))
+		lzma.extract();
+	else
+		lzma.compress();
 
 	qDebug("unpack size: %d, pack size: %d", lzma.unpackSize(), lzma.packSize());
 
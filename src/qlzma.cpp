@@ -1,62 +1,248 @@
 #include "qlzma.h"
 
-#include <fstream>
 #include <vector>
 #include <assert.h>
+#include <limits.h>
 
 #include <qfile.h>
 #include <qfileinfo.h>
 #include <qdatetime.h>
+#include <qthread.h>
+#include <qatomic.h>
+#include <qmutex.h>
+#include <qwaitcondition.h>
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "lzma/C/Types.h"
 #include "lzma/C/LzmaEnc.h"
-
+#include "lzma/C/LzmaDec.h"
+#include "lzma/C/Lzma2Enc.h"
+#include "lzma/C/Lzma2Dec.h"
+#include "lzma/C/Lzma2DecMt.h"
+
+#include "qlzmastream.h"
+#include "qlzmaindex.h"
+#include "qlzmaencoder.h"
+#include "qlzmaalloc.h"
+#include "qlzmaplan.h"
+#include "qtar.h"
+//QLZMA_NO_GUI: QtCore only, e.g. the command line tool. compress()/extract() show no progress dialog
+#ifndef QLZMA_NO_GUI
 #include "qtcompat.h"
 #include "gui/ezprogressdialog.h"
-#include "utils/qt_util.h"
+#endif //QLZMA_NO_GUI
 #include "utils/convert.h"
 #include "msgdef.h"
 
 #define LZMA86_SIZE_OFFSET (1 + LZMA_PROPS_SIZE)
 #define LZMA86_HEADER_SIZE (LZMA86_SIZE_OFFSET + 8)
+#define LZMA86_SIZE_UNKNOWN ((UInt64)(Int64)-1)
+
+#define LZMA2_HEADER_MARK 2
+#define LZMA2_SIZE_OFFSET 2
+#define LZMA2_HEADER_SIZE (LZMA2_SIZE_OFFSET + 8)
+
+#define LZMA_IN_BUF_SIZE (1 << 18)
+
+static void writeSize(Byte *p, UInt64 size)
+{
+	for (int i = 0; i < 8; i++, size >>= 8)
+		p[i] = (Byte)size;
+}
+
+static UInt64 readSize(const Byte *p)
+{
+	UInt64 size = 0;
+	for (int i = 0; i < 8; i++)
+		size |= (UInt64)p[i] << (8 * i);
+	return size;
+}
+
+static void writeLzma86Size(Byte *header, UInt64 size)
+{
+	writeSize(header + LZMA86_SIZE_OFFSET, size);
+}
+
+static UInt64 readLzma86Size(const Byte *header)
+{
+	return readSize(header + LZMA86_SIZE_OFFSET);
+}
+
+//the header is lzma86 or lzma2, the first byte tells which one
+static UInt64 readHeaderSize(const Byte *header)
+{
+	if (header[0] == LZMA2_HEADER_MARK)
+		return readSize(header + LZMA2_SIZE_OFFSET);
+	return readLzma86Size(header);
+}
+
+/*!
+	Maps size bytes from the current position of f, so the encoder reads the file through the page cache
+	instead of copying it into its own window. Returns 0 if it can not be mapped (e.g. a pipe).
+*/
+static uchar* mapInput(QFile *f, qint64 size)
+{
+	if (size <= 0 || (UInt64)(SizeT)size != (UInt64)size)
+		return 0;
+	uchar *data = f->map(f->pos(), size);
+#if defined(Q_OS_UNIX) && defined(MADV_SEQUENTIAL)
+	if (data) {
+		quintptr pageMask = sysconf(_SC_PAGESIZE) - 1;
+		uchar *start = (uchar*)((quintptr)data & ~pageMask);
+		madvise(start, size + (data - start), MADV_SEQUENTIAL);
+	}
+#endif //Q_OS_UNIX
+	return data;
+}
+
+/*!
+	Extends f to hold size bytes from the current position and maps them, so a decoder can use
+	the file itself as the output buffer. f must be opened ReadWrite. Returns 0 if it is not possible.
+*/
+static uchar* mapOutput(QFile *f, UInt64 size)
+{
+	if (size == LZMA86_SIZE_UNKNOWN || size == 0 || (UInt64)(SizeT)size != size)
+		return 0;
+	qint64 pos = f->pos();
+	if (!f->resize(pos + size))
+		return 0;
+	uchar *data = f->map(pos, size);
+	if (!data)
+		f->resize(pos);
+	return data;
+}
+
+//The same decoding loop is used for LZMA and LZMA2
+static inline CLzmaDec* lzmaDecoder(CLzmaDec *p) { return p; }
+static inline CLzmaDec* lzmaDecoder(CLzma2Dec *p) { return &p->decoder; }
+
+static inline SRes decodeToDic(CLzmaDec *p, SizeT dicLimit, const Byte *src, SizeT *srcLen, ELzmaFinishMode finishMode, ELzmaStatus *status)
+{
+	return LzmaDec_DecodeToDic(p, dicLimit, src, srcLen, finishMode, status);
+}
+
+static inline SRes decodeToDic(CLzma2Dec *p, SizeT dicLimit, const Byte *src, SizeT *srcLen, ELzmaFinishMode finishMode, ELzmaStatus *status)
+{
+	return Lzma2Dec_DecodeToDic(p, dicLimit, src, srcLen, finishMode, status);
+}
+
+//the coder states and buffers
+static inline ISzAlloc* smallAlloc() { return QLzmaAllocator::get(QLzmaAllocator::Small); }
+//the match finder and the decoder dictionary, huge pages if possible
+static inline ISzAlloc* bigAlloc() { return QLzmaAllocator::get(QLzmaAllocator::Big); }
+
+//LzmaDec_Free() would free the dictionary with the allocator of the probs
+static void freeDecoder(CLzmaDec *p)
+{
+	bigAlloc()->Free(bigAlloc(), p->dic);
+	p->dic = 0;
+	LzmaDec_FreeProbs(p, smallAlloc());
+}
+
+static inline void freeDecoder(CLzma2Dec *p) { freeDecoder(&p->decoder); }
 
 /*!
-SzAllocForLzma is another interface which gives LZMA library pointers to the memory allocation and deallocation functions. To just use standard malloc and free functions, you can copy this code:
+	The sizes reported by the encoder/decoder thread(s), sampled by the gui thread.
+	A seqlock: the writer makes seq odd while it writes, so the reader never waits
+	for the writer and retries if it read in the middle of an update.
+	Writers must be serialized (LzmaEnc and MtCoder/Lzma2DecMt call ICompressProgress from one thread at a time)
 */
-static void * AllocForLzma(void *p, size_t size) { return malloc(size); }
-static void FreeForLzma(void *p, void *address) { free(address); }
-static ISzAlloc SzAllocForLzma = { &AllocForLzma, &FreeForLzma };
+class QLzmaProgress
+{
+public:
+	QLzmaProgress():inSize(0),outSize(0) {}
+	void set(UInt64 in, UInt64 out) {
+		seq.fetchAndAddOrdered(1);
+		inSize = in;
+		outSize = out;
+		seq.fetchAndAddOrdered(1);
+	}
+	void get(UInt64 *in, UInt64 *out) const {
+		int s0, s1;
+		do {
+			s0 = seq.fetchAndAddOrdered(0);
+			*in = inSize;
+			*out = outSize;
+			s1 = seq.fetchAndAddOrdered(0);
+		} while ((s0 & 1) || s0 != s1);
+	}
+	void reset() { set(0, 0); }
+private:
+	mutable QAtomicInt seq;
+	volatile UInt64 inSize, outSize;
+};
+
+//progress() is 0 out of compressStream()/extractStream()
+class QLzmaProgressScope
+{
+public:
+	QLzmaProgressScope(QLzmaProgress *p):counter(p) { counter->reset(); }
+	~QLzmaProgressScope() { counter->reset(); }
+private:
+	QLzmaProgress *counter;
+};
 
 class CompressProgressGui : public ICompressProgress
 {
 public:
     CompressProgressGui(QLzmaPrivate *p):q(p) {}
-    void updateGui(UInt64 inSize, UInt64 outSize);
+    SRes updateGui(UInt64 inSize, UInt64 outSize);
 private:
     QLzmaPrivate *q;
 };
 
+//Runs compressStream()/extractStream() so the gui thread only samples the progress
+class QLzmaWorker : public QThread
+{
+public:
+	QLzmaWorker(QLzma *lzma, bool compress, QFile *in, QFile *out, int level)
+		:q(lzma),compress_mode(compress),in(in),out(out),level(level),res(SZ_OK)
+	{}
+	int result() const { return res; }
+protected:
+	void run() {
+		if (compress_mode)
+			res = q->compressStream(in, out, in->size(), level);
+		else
+			res = q->extractStream(in, out);
+	}
+private:
+	QLzma *q;
+	bool compress_mode;
+	QFile *in, *out;
+	int level;
+	int res;
+};
+
 class QLzmaPrivate {
 	Q_DECLARE_PUBLIC(QLzma)
 public:
 	QLzmaPrivate()
-		:compress_mode(true),q_ptr(0),pack_file(""),unpack_file(""),level(7)
-		,totalSize(0),processedSize(0),extra_msg(QObject::tr("Calculating..."))
-		,last_elapsed(1),elapsed(0),time_passed(0),pause(false),left(0),ratio(1.0)
+		:compress_mode(true),q_ptr(0),pack_file(""),unpack_file(""),level(7),threads(0),format(QLzma::Lzma86),blockSize(0),seekIndex(false),memoryLimit(0)
+		,totalSize(0),processedSize(0),compressedSize(0),uncompressedSize(0),progress_shift(0),extra_msg(QObject::tr("Calculating..."))
+		,last_elapsed(1),elapsed(0),time_passed(0),pause(false),abort(false),left(0),ratio(1.0),tid(0)
+		,has_enc_stats(false),in_file(0),out_file(0),worker(0)
         ,progressCallBack(new CompressProgressGui(this))
 	{
 		init();
 	}
 
 	~QLzmaPrivate() {
+		cancel();
+		finishJob();
 		if(progressCallBack) {
 			delete progressCallBack;
 			progressCallBack = 0;
 		}
+#ifndef QLZMA_NO_GUI
 		if (progress) {
 			delete progress;
 			progress = 0;
 		}
+#endif //QLZMA_NO_GUI
 	}
 
 	void setUnpackFile(const QString& path) {
@@ -79,14 +265,92 @@ public:
 		else
 			totalSize = QFile(pack_file).size();
 
-		max_str=QString(" / %1").arg(size2str(totalSize));initGui();
+		max_str=QString(" / %1").arg(size2str(totalSize));
+		progress_shift = 0;
+		while ((totalSize >> progress_shift) > 0x7FFFFFFF) //QProgressBar takes int
+			++progress_shift;
+#ifndef QLZMA_NO_GUI
+		initGui();
 		QObject::connect(progress->button(0), SIGNAL(clicked()), progress, SLOT(hide())); //Hide the widget will be faster. not showMinimum
 		QObject::connect(progress->button(1), SIGNAL(clicked()), q_ptr, SLOT(pauseOrResume()));
 		QObject::connect(progress, SIGNAL(canceled()), q_ptr, SLOT(stop()));
-		progress->setMaximum(totalSize);
+		progress->setMaximum(totalSize >> progress_shift);
+#endif //QLZMA_NO_GUI
+		counter.reset();
+		pause = false;
+		abort = false;
 		time.restart();
 	}
 
+	bool isRunning() const {
+		return worker != 0;
+	}
+
+	//Opens the files and starts the worker. unpack_file and pack_file are set
+	bool startJob(QLzma *q) {
+		QString in_name = compress_mode ? unpack_file : pack_file;
+		QString out_name = compress_mode ? pack_file : unpack_file;
+		in_file = new QFile(in_name);
+		if (!in_file->open(QIODevice::ReadOnly | QIODevice::Unbuffered)) { //LzmaEnc has its own buffers
+			qWarning("Failed to open %s: %s", qPrintable(in_name), qPrintable(in_file->errorString()));
+			finishJob();
+			return false;
+		}
+		out_file = new QFile(out_name);
+		//ReadWrite: LZMA2 blocks are decoded in parallel into the mapped file
+		QIODevice::OpenMode mode = compress_mode ? QIODevice::WriteOnly : QIODevice::ReadWrite | QIODevice::Truncate;
+		if (!out_file->open(mode | QIODevice::Unbuffered)) {
+			qWarning("Failed to open %s: %s", qPrintable(out_name), qPrintable(out_file->errorString()));
+			finishJob();
+			return false;
+		}
+		prepare(q);
+		worker = new QLzmaWorker(q, compress_mode, in_file, out_file, level);
+		worker->start();
+		tid = q->startTimer(100);
+		return true;
+	}
+
+	//The worker sleeps on pause_cond in the progress callback until resumed or canceled
+	void setPaused(bool paused) {
+		QMutexLocker lock(&pause_mutex);
+		pause = paused;
+		if (!pause)
+			pause_cond.wakeAll();
+	}
+
+	void cancel() {
+		QMutexLocker lock(&pause_mutex);
+		abort = true;
+		pause_cond.wakeAll();
+	}
+
+	//Waits for the worker and closes the files. Returns the result of the job
+	int finishJob() {
+		int res = SZ_OK;
+		if (tid) {
+			q_ptr->killTimer(tid);
+			tid = 0;
+		}
+		if (worker) {
+			worker->wait();
+			res = worker->result();
+			delete worker;
+			worker = 0;
+		}
+		if (out_file && abort && res == SZ_ERROR_PROGRESS) {
+			out_file->remove(); //canceled. the output is incomplete
+		} else if (out_file && res != SZ_OK) {
+			qWarning("%s %s error(%d): %s", compress_mode ? "Compress" : "Extract"
+					 , qPrintable(compress_mode ? unpack_file : pack_file), res, qPrintable(out_file->errorString()));
+		}
+		delete in_file;
+		in_file = 0;
+		delete out_file;
+		out_file = 0;
+		return res;
+	}
+
 
 	void prepareNames() {
 		if (!compress_mode) {
@@ -99,12 +363,58 @@ public:
 		//qDebug("pack: %s, unpack: %s", qPrintable(pack_file), qPrintable(unpack_file));
 	}
 
+	int numThreads() const {
+		if (threads > 0)
+			return threads;
+		return qMax(1, QThread::idealThreadCount());
+	}
+
+	//LZMA, through memoryLimit if any
+	CLzmaEncProps encoderProps(qint64 size, int level, unsigned int dictSize) const {
+		if (memoryLimit > 0)
+			return QLzmaMemoryPlan::make(QLzma::Lzma86, level, dictSize, size, memoryLimit, numThreads()).props;
+		CLzmaEncProps props;
+		LzmaEncProps_Init(&props);
+		props.level = level;
+		props.dictSize = dictSize;
+		props.numThreads = numThreads() > 1 ? 2 : 1;
+		if (size >= 0)
+			props.reduceSize = size;
+		return props;
+	}
+	int compressLzma2(QIODevice *in, QIODevice *out, qint64 size, int level, unsigned int dictSize);
+	bool loadIndex(QIODevice *dev);
+	bool decodeLzma2Mapped(QFile *in, QFile *out, Byte prop, UInt64 unpackSize, int *res);
+	template<typename Decoder>
+	int decode(Decoder *dec, QIODevice *in, QIODevice *out, UInt64 unpackSize, UInt64 inProcessed, Byte *outBuf = 0);
+
 	void estimate() {
 		if(!pause)
 			elapsed = last_elapsed + time.elapsed();
 		speed = processedSize/(1+elapsed)*1000; //>0
 		left = (qreal)(totalSize-processedSize)/(qreal)(1+speed);
-		ratio = 100.0 * (qreal)compressedSize/(qreal)processedSize;
+		ratio = 100.0 * (qreal)compressedSize/(qreal)(1+uncompressedSize);
+	}
+
+	//Called by the timer in the gui thread
+	void updateGui() {
+		UInt64 inSize, outSize;
+		counter.get(&inSize, &outSize);
+		//inSize is what has been read: the unpacked bytes if compressing, the packed bytes if extracting
+		processedSize = inSize;
+		if (compress_mode) {
+			uncompressedSize = inSize;
+			compressedSize = outSize;
+		} else {
+			compressedSize = inSize;
+			uncompressedSize = outSize;
+		}
+		estimate();
+		updateMessage();
+#ifndef QLZMA_NO_GUI
+		progress->setValue(processedSize >> progress_shift);
+		progress->setLabelText(out_msg + extra_msg);
+#endif //QLZMA_NO_GUI
 	}
 
 	void updateMessage() {
@@ -117,11 +427,14 @@ public:
 	void showFinish() {
 		processedSize = totalSize;
 		compressedSize = QFile(pack_file).size();
+		uncompressedSize = QFile(unpack_file).size();
 		estimate();
 		updateMessage();
-		progress->setValue(processedSize);
+#ifndef QLZMA_NO_GUI
+		progress->setValue(processedSize >> progress_shift);
 		progress->setLabelText(out_msg + extra_msg);
 		qApp->processEvents();
+#endif //QLZMA_NO_GUI
 	}
 
     static SRes OnProgress(void *p, UInt64 inSize, UInt64 outSize);
@@ -131,18 +444,35 @@ public:
 	QString pack_file, unpack_file;
 	QString in_path, out_path;
 	int level;
+	int threads; //0: auto
+	QLzma::Format format;
+	size_t blockSize; //LZMA2. 0: auto
+	bool seekIndex; //LZMA2. write the block index after the stream
+	quint64 memoryLimit; //encoder bytes, 0: no limit
+	QLzmaIndex index; //blocks of index_file for readAt()
+	QString index_file;
 
 	QTime time;
-	uint totalSize, processedSize, compressedSize, uncompressedSize;
+	qint64 totalSize, processedSize, compressedSize, uncompressedSize;
+	int progress_shift;
 	//uint interval;
 	QString out_msg, extra_msg;
 	QString max_str;
 	uint last_elapsed, elapsed, speed; //ms
 	int time_passed;
 	volatile bool pause;
+	volatile bool abort;
 	qreal left;
 	qreal ratio;
-	int tid;
+	int tid; //progress timer of the running job
+	QMutex pause_mutex;
+	QWaitCondition pause_cond;
+	QLzmaProgress counter;
+	QLzmaAllocCounter alloc_counter; //the allocations of the last compressStream()/extractStream()/compressData()
+	CLzmaEncStats enc_stats; //of the last compression, if the library counts them
+	bool has_enc_stats;
+	QFile *in_file, *out_file;
+	QLzmaWorker *worker;
 
 private:
 	void init() {
@@ -152,6 +482,7 @@ private:
 		time = QTime::currentTime();
 	}
 
+#ifndef QLZMA_NO_GUI
 	void initGui() {
 		if (!progress) {
 			progress = new EZProgressDialog(QObject::tr("Calculating..."));
@@ -169,32 +500,32 @@ private:
 	}
 
 	static EZProgressDialog *progress;
+#endif //QLZMA_NO_GUI
 	ICompressProgress *progressCallBack;
     friend class CompressProgressGui;
 };
 
+#ifndef QLZMA_NO_GUI
 EZProgressDialog* QLzmaPrivate::progress = 0; //DO NOT new. Because it is before qApp created;
+#endif //QLZMA_NO_GUI
 
-void CompressProgressGui::updateGui(UInt64 inSize, UInt64 outSize)
+//Called in the worker thread (or an LZMA2 block thread). No widget can be touched here
+SRes CompressProgressGui::updateGui(UInt64 inSize, UInt64 outSize)
 {
-    q->compressedSize = outSize;
-    q->processedSize = inSize;
-
-    q->estimate();
-    q->updateMessage();
-
-    q->progress->setValue(inSize);
-    q->progress->setLabelText(q->out_msg + q->extra_msg);
-    qApp->processEvents();
+    q->counter.set(inSize, outSize);
+    if (q->pause) {
+        QMutexLocker lock(&q->pause_mutex);
+        while (q->pause && !q->abort)
+            q->pause_cond.wait(&q->pause_mutex);
+    }
+    return q->abort ? SZ_ERROR_PROGRESS : SZ_OK;
 }
 
 //p is ICompressProgress* !!
 SRes QLzmaPrivate::OnProgress(void *p, UInt64 inSize, UInt64 outSize)
 {
-	Q_UNUSED(p);
     CompressProgressGui *gui = static_cast<CompressProgressGui*>(p);
-    gui->updateGui(inSize, outSize);
-	return SZ_OK;
+    return gui->updateGui(inSize, outSize);
 }
 
 
@@ -252,27 +583,26 @@ int QLzma::compressData(const unsigned char *data, size_t len, unsigned char *ou
 {
 	if(*destLen < LZMA86_HEADER_SIZE)
 		return SZ_ERROR_OUTPUT_EOF;
-	size_t propsSize = LZMA_PROPS_SIZE;
 	size_t outSizeProcessed = *destLen - LZMA86_HEADER_SIZE;
 	//std::vector<char> outBuf;
 	//outBuf.resize(destLen);
-	CLzmaEncProps props;
-	LzmaEncProps_Init(&props);
-	props.level = level;
-	props.dictSize = dictSize;//1 << 16; // 64 KB
-	//props.writeEndMark = 0; // 0 or 1
-
-	//write size to header
-	UInt64 t = len;
-	for (int i = 0; i < 8; i++, t >>= 8) outBuf[LZMA86_SIZE_OFFSET + i] = (Byte)t;
-
 	Q_D(QLzma);
-	int curRes = LzmaEncode( outBuf+LZMA86_HEADER_SIZE/*(Byte*)&outBuf[LZMA_PROPS_SIZE]*/,
-		&outSizeProcessed, (Byte*)data, len,
-		&props, outBuf+1, &propsSize, props.writeEndMark,
-		d->progressCallBack, &SzAllocForLzma, &SzAllocForLzma);
-
-	assert(curRes == SZ_OK && propsSize == LZMA_PROPS_SIZE);
+	QLzmaAllocStatsScope allocScope(&d->alloc_counter);
+	//the encoders are reused, so small buffers do not pay for the match finder allocation
+	QLzmaEncoderPool *pool = QLzmaEncoderPool::instance();
+	d->has_enc_stats = false;
+	QLzmaEncoder *enc = pool->acquire(d->encoderProps(len, level, dictSize));
+	if (!enc)
+		return SZ_ERROR_MEM;
+
+	writeLzma86Size(outBuf, len);
+
+	int curRes = enc->writeProperties(outBuf + 1);
+	if (curRes == SZ_OK)
+		curRes = enc->encode(outBuf+LZMA86_HEADER_SIZE/*(Byte*)&outBuf[LZMA_PROPS_SIZE]*/,
+			&outSizeProcessed, (const Byte*)data, len, false, d->progressCallBack);
+	d->has_enc_stats = enc->stats(&d->enc_stats) == SZ_OK;
+	pool->release(enc);
 	outBuf[0]=0;
 
 	*destLen = LZMA86_HEADER_SIZE + outSizeProcessed;
@@ -280,42 +610,167 @@ int QLzma::compressData(const unsigned char *data, size_t len, unsigned char *ou
 
 }
 
-void QLzma::compress()
+/*!
+	Same lzma86 layout as compressData(), but the data is pulled from in and pushed to out
+	through LzmaEnc_Encode piece by piece, so the memory is bounded by the encoder state
+	(about dictSize*11.5) whatever the input size is.
+	If in is a QFile which can be mapped, the mapping is the match finder window (directInput)
+	and the file is not copied at all.
+	If size < 0 (e.g. stdin), the size field is 0xFFFFFFFFFFFFFFFF and an end marker is written.
+*/
+int QLzma::compressStream(QIODevice *in, QIODevice *out, qint64 size, int level, unsigned int dictSize)
 {
 	Q_D(QLzma);
-
-	d->prepareNames();
-	QFile in(d->unpack_file);
-	if (!in.open(QIODevice::ReadOnly)) {
-		qWarning("Failed to open %s: %s", qPrintable(d->unpack_file), qPrintable(in.errorString()));
-		return;
+	QLzmaProgressScope scope(&d->counter);
+	QLzmaAllocStatsScope allocScope(&d->alloc_counter);
+	d->has_enc_stats = false;
+	if (d->format == Lzma2)
+		return d->compressLzma2(in, out, size, level, dictSize);
+
+	QLzmaEncoderPool *pool = QLzmaEncoderPool::instance();
+	QLzmaEncoder *enc = pool->acquire(d->encoderProps(size, level, dictSize));
+	if (!enc)
+		return SZ_ERROR_MEM;
+	Byte header[LZMA86_HEADER_SIZE];
+	int res = enc->writeProperties(header + 1);
+	if (res == SZ_OK) {
+		header[0] = 0;
+		writeLzma86Size(header, size < 0 ? LZMA86_SIZE_UNKNOWN : (UInt64)size);
+		if (out->write((const char*)header, LZMA86_HEADER_SIZE) != LZMA86_HEADER_SIZE)
+			res = SZ_ERROR_WRITE;
 	}
-	size_t size = in.size();
-	QByteArray in_buffer = in.readAll();
-	in.close();
+	if (res == SZ_OK) {
+		QLzmaOutStream outStream(out);
+		QFile *inFile = qobject_cast<QFile*>(in);
+		uchar *data = inFile ? mapInput(inFile, size) : 0;
+		if (data) {
+			qint64 pos = inFile->pos();
+			res = enc->encode(&outStream, data, (SizeT)size, false, d->progressCallBack);
+			inFile->unmap(data);
+			inFile->seek(pos + size);
+		} else {
+			QLzmaInStream inStream(in);
+			res = enc->encode(&outStream, &inStream, size < 0, d->progressCallBack);
+		}
+	}
+	d->has_enc_stats = enc->stats(&d->enc_stats) == SZ_OK;
+	pool->release(enc);
+	return res;
+}
 
-	//Byte *out_buffer=new Byte[size];
-	QByteArray out_buffer(size, 0);
-	size_t len_compressed = LZMA86_HEADER_SIZE + size + size / 3 + 128;
+int QLzma::compressDirectory(const QString &dir, QIODevice *out, int level, unsigned int dictSize)
+{
+	if (!QFileInfo(dir).exists())
+		return SZ_ERROR_READ;
+	QTarArchiver tar(dir);
+	tar.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+	return compressStream(&tar, out, -1, level, dictSize);
+}
 
-	d->prepare(this);
-	compressData((Byte*)in_buffer.constData(), size, (Byte*)out_buffer.data(), &len_compressed, d->level);
-	d->showFinish();
-	emit finished();
+int QLzma::extractDirectory(QIODevice *in, const QString &dir)
+{
+	QTarExtractor tar(dir);
+	tar.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+	int res = extractStream(in, &tar);
+	if (res == SZ_ERROR_WRITE)
+		qWarning("%s", qPrintable(tar.errorString()));
+	else if (res == SZ_OK && !tar.isFinished())
+		res = SZ_ERROR_DATA; //truncated archive
+	return res;
+}
 
-	QFile out(d->pack_file);
-	if (!out.open(QIODevice::WriteOnly)) {
-		qWarning("Failed to open %s: %s", qPrintable(d->pack_file), qPrintable(out.errorString()));
-		return;
+/*!
+lzma2 header (10 bytes):
+  Offset Size  Description
+	0     1    = 2 - LZMA2 (lzma86 uses 0 and 1 for the filter)
+	1     1    dictSize in LZMA2 encoded form (Lzma2Enc_WriteProperties)
+	2     8    uncompressed size (little endian), 0xFFFFFFFFFFFFFFFF if unknown
+  The LZMA2 chunks follow. Each block of blockSize bytes starts with a dictionary reset, so blocks
+  can be compressed in parallel (numBlockThreads), and incompressible chunks are stored as is.
+*/
+int QLzmaPrivate::compressLzma2(QIODevice *in, QIODevice *out, qint64 size, int level, unsigned int dictSize)
+{
+	CLzma2EncProps props;
+	Lzma2EncProps_Init(&props);
+	props.lzmaProps.level = level;
+	props.lzmaProps.dictSize = dictSize;
+	if (size >= 0)
+		props.lzmaProps.reduceSize = size;
+	props.lzmaProps.numThreads = 1; //see QLzmaMemoryPlan::make()
+	props.numBlockThreads = numThreads();
+	props.blockSize = blockSize;
+	if (memoryLimit > 0)
+		QLzmaMemoryPlan::make(QLzma::Lzma2, level, dictSize, size, memoryLimit, numThreads(), blockSize).apply(&props);
+
+	CLzma2EncHandle enc = Lzma2Enc_Create(smallAlloc(), bigAlloc());
+	if (!enc)
+		return SZ_ERROR_MEM;
+	int res = Lzma2Enc_SetProps(enc, &props);
+	if (res == SZ_OK) {
+		Byte header[LZMA2_HEADER_SIZE];
+		header[0] = LZMA2_HEADER_MARK;
+		header[1] = Lzma2Enc_WriteProperties(enc);
+		writeSize(header + LZMA2_SIZE_OFFSET, size < 0 ? LZMA86_SIZE_UNKNOWN : (UInt64)size);
+		if (out->write((const char*)header, LZMA2_HEADER_SIZE) != LZMA2_HEADER_SIZE)
+			res = SZ_ERROR_WRITE;
+	}
+	if (res == SZ_OK) {
+		QLzmaInStream inStream(in);
+		QLzmaOutStream outStream(out);
+		QLzmaIndex blocks;
+		QLzmaIndexOutStream indexStream(&outStream, &blocks);
+		res = Lzma2Enc_Encode(enc, seekIndex ? (ISeqOutStream*)&indexStream : &outStream, &inStream, progressCallBack);
+		has_enc_stats = Lzma2Enc_GetStats(enc, &enc_stats) == SZ_OK;
+		if (res == SZ_OK && seekIndex) {
+			QByteArray trailer = blocks.trailer();
+			if (out->write(trailer) != trailer.size())
+				res = SZ_ERROR_WRITE;
+		}
 	}
-	//size_t len_write = out.write((const char*)&out_buffer[0], len_compressed);
-	size_t len_write = out.write(out_buffer, len_compressed);
-	if (len_write != len_compressed) {
-		qWarning("Write %s error(%u/%u writed): %s", qPrintable(d->pack_file), len_write, len_compressed, qPrintable(out.errorString()));
+	Lzma2Enc_Destroy(enc);
+	return res;
+}
+
+/*!
+	Compresses in a worker thread and returns immediately. finished() is emitted when done
+*/
+void QLzma::compress()
+{
+	Q_D(QLzma);
+	if (d->isRunning()) {
+		qWarning("QLzma is busy");
 		return;
 	}
-	out.close();
-	//delete [] out_buffer;
+	d->compress_mode = true;
+	d->prepareNames();
+	d->index_file.clear();
+	d->startJob(this);
+}
+
+void QLzma::progress(quint64 *inSize, quint64 *outSize) const
+{
+	Q_D(const QLzma);
+	UInt64 in, out;
+	d->counter.get(&in, &out);
+	if (inSize)
+		*inSize = in;
+	if (outSize)
+		*outSize = out;
+}
+
+QLzmaAllocStats QLzma::allocStats() const
+{
+	Q_D(const QLzma);
+	return d->alloc_counter.stats();
+}
+
+bool QLzma::encoderStats(CLzmaEncStats *stats) const
+{
+	Q_D(const QLzma);
+	if (!d->has_enc_stats)
+		return false;
+	*stats = d->enc_stats;
+	return true;
 }
 
 size_t QLzma::packSize() const
@@ -333,24 +788,17 @@ size_t QLzma::unpackSize() const
 	if (d->compress_mode)
 		return QFile(d->unpack_file).size();
 
-	std::ifstream is;
-	is.open(qPrintable(d->pack_file), std::ios_base::binary | std::ios_base::in);
-	is.seekg(0, std::ios_base::end);
-	size_t unpackSize = is.tellg();
-
-	if (unpackSize < LZMA86_HEADER_SIZE) {
+	QFile f(d->pack_file);
+	Byte header[LZMA86_HEADER_SIZE]; //lzma2 header is shorter
+	if (!f.open(QIODevice::ReadOnly) || f.read((char*)header, LZMA2_HEADER_SIZE) != LZMA2_HEADER_SIZE) {
 		qWarning("SZ_ERROR_INPUT_EOF");
-		is.close();
 		return -1;
 	}
-
-	is.seekg(LZMA86_SIZE_OFFSET, std::ios_base::beg);
-	char size_block[sizeof(UInt64)];
-	is.read(size_block, sizeof(UInt64));
-	for (unsigned i = 0; i < sizeof(UInt64); ++i)
-		unpackSize += ((UInt64)size_block[i]) << (i<<3);
-	is.close();
-	return unpackSize;
+	if (header[0] != LZMA2_HEADER_MARK && f.read((char*)header + LZMA2_HEADER_SIZE, LZMA86_HEADER_SIZE - LZMA2_HEADER_SIZE) != LZMA86_HEADER_SIZE - LZMA2_HEADER_SIZE) {
+		qWarning("SZ_ERROR_INPUT_EOF");
+		return -1;
+	}
+	return readHeaderSize(header);
 }
 
 void QLzma::setUncompressedFile(const QString &file)
@@ -371,48 +819,459 @@ void QLzma::setLevel(int level)
 	d->level = level;
 }
 
-void QLzma::extract()
+void QLzma::setThreads(int threads)
+{
+	Q_D(QLzma);
+	d->threads = qMax(0, threads);
+}
+
+int QLzma::threads() const
+{
+	Q_D(const QLzma);
+	return d->numThreads();
+}
+
+void QLzma::setFormat(Format format)
+{
+	Q_D(QLzma);
+	d->format = format;
+}
+
+QLzma::Format QLzma::format() const
+{
+	Q_D(const QLzma);
+	return d->format;
+}
+
+void QLzma::setBlockSize(size_t size)
+{
+	Q_D(QLzma);
+	d->blockSize = size;
+}
+
+size_t QLzma::blockSize() const
+{
+	Q_D(const QLzma);
+	return d->blockSize;
+}
+
+void QLzma::setSeekIndex(bool enable)
 {
+	Q_D(QLzma);
+	d->seekIndex = enable;
+}
 
+bool QLzma::seekIndex() const
+{
+	Q_D(const QLzma);
+	return d->seekIndex;
+}
+
+void QLzma::setMemoryLimit(quint64 bytes)
+{
+	Q_D(QLzma);
+	d->memoryLimit = bytes;
+}
+
+quint64 QLzma::memoryLimit() const
+{
+	Q_D(const QLzma);
+	return d->memoryLimit;
+}
+
+QLzmaMemoryPlan QLzma::memoryPlan(qint64 inputSize, int level, unsigned int dictSize) const
+{
+	Q_D(const QLzma);
+	return QLzmaMemoryPlan::make(d->format, level, dictSize, inputSize, d->memoryLimit, d->numThreads(), d->blockSize);
+}
+
+//dev is at the first chunk
+bool QLzmaPrivate::loadIndex(QIODevice *dev)
+{
+	if (index_file == pack_file)
+		return true;
+	qint64 streamPos = dev->pos();
+	if (!index.readTrailer(dev, streamPos) && !index.scan(dev, streamPos)) {
+		index_file.clear();
+		return false;
+	}
+	index_file = pack_file;
+	return true;
+}
+
+/*!
+	Only the blocks covering [offset, offset + len) are decoded: the block index is read from the
+	trailer if the file has one (setSeekIndex()), otherwise the chunk headers are walked once.
+	The result is shorter than len if the data ends before offset + len.
+*/
+QByteArray QLzma::readAt(quint64 offset, size_t len)
+{
+	Q_D(QLzma);
+	d->prepareNames();
+	QFile f(d->pack_file);
+	Byte header[LZMA2_HEADER_SIZE];
+	if (!f.open(QIODevice::ReadOnly) || f.read((char*)header, LZMA2_HEADER_SIZE) != LZMA2_HEADER_SIZE
+			|| header[0] != LZMA2_HEADER_MARK) {
+		qWarning("readAt: %s is not an lzma2 file", qPrintable(d->pack_file));
+		return QByteArray();
+	}
+	if (!d->loadIndex(&f)) {
+		qWarning("readAt: bad lzma2 stream %s", qPrintable(d->pack_file));
+		return QByteArray();
+	}
+	int block = d->index.find(offset);
+	if (block < 0 || len == 0)
+		return QByteArray();
+	UInt64 end = offset + len;
+	if (end > d->index.unpackSize() || end < offset)
+		end = d->index.unpackSize();
+	if (end - offset > (UInt64)INT_MAX) {
+		qWarning("readAt: range is too large for a QByteArray");
+		return QByteArray();
+	}
+	QByteArray data;
+	data.resize((int)(end - offset));
+
+	CLzma2Dec dec;
+	Lzma2Dec_Construct(&dec);
+	if (Lzma2Dec_AllocateProbs(&dec, header[1], smallAlloc()) != SZ_OK)
+		return QByteArray();
+	UInt64 outPos = d->index.at(block).unpackPos;
+	CLzmaDec *lz = &dec.decoder;
+	lz->dicBufSize = lz->prop.dicSize;
+	if (end - outPos < lz->dicBufSize)
+		lz->dicBufSize = (SizeT)(end - outPos);
+	lz->dic = (Byte*)bigAlloc()->Alloc(bigAlloc(), lz->dicBufSize);
+	Byte *inBuf = (Byte*)smallAlloc()->Alloc(smallAlloc(), LZMA_IN_BUF_SIZE);
+	int res = (lz->dic && inBuf && f.seek(LZMA2_HEADER_SIZE + d->index.at(block).packPos)) ? SZ_OK : SZ_ERROR_MEM;
+	Lzma2Dec_Init(&dec);
+	size_t inPos = 0, inSize = 0;
+	while (res == SZ_OK && outPos < end) {
+		if (inPos == inSize) {
+			qint64 n = f.read((char*)inBuf, LZMA_IN_BUF_SIZE);
+			if (n <= 0) {
+				res = SZ_ERROR_INPUT_EOF;
+				break;
+			}
+			inSize = n;
+			inPos = 0;
+		}
+		if (lz->dicPos == lz->dicBufSize)
+			lz->dicPos = 0;
+		SizeT dicPos = lz->dicPos;
+		SizeT dicLimit = lz->dicBufSize;
+		if (end - outPos < dicLimit - dicPos)
+			dicLimit = dicPos + (SizeT)(end - outPos);
+		SizeT inLen = inSize - inPos;
+		ELzmaStatus status;
+		res = Lzma2Dec_DecodeToDic(&dec, dicLimit, inBuf + inPos, &inLen, LZMA_FINISH_ANY, &status);
+		inPos += inLen;
+		SizeT outLen = lz->dicPos - dicPos;
+		//copy what overlaps the requested range
+		UInt64 from = qMax(outPos, (UInt64)offset);
+		if (outPos + outLen > from)
+			memcpy(data.data() + (from - offset), lz->dic + dicPos + (from - outPos), (size_t)(outPos + outLen - from));
+		outPos += outLen;
+		if (res == SZ_OK && inLen == 0 && outLen == 0)
+			res = status == LZMA_STATUS_FINISHED_WITH_MARK ? SZ_OK : SZ_ERROR_DATA;
+		if (status == LZMA_STATUS_FINISHED_WITH_MARK)
+			break;
+	}
+	smallAlloc()->Free(smallAlloc(), inBuf);
+	freeDecoder(&dec);
+	if (res != SZ_OK) {
+		qWarning("readAt %s error(%d)", qPrintable(d->pack_file), res);
+		return QByteArray();
+	}
+	data.resize((int)(qMin(outPos, end) - offset));
+	return data;
+}
+
+bool QLzma::readHeader(QIODevice *in, Format *format, qint64 *unpackSize, quint32 *dictSize)
+{
+	Byte header[LZMA86_HEADER_SIZE];
+	if (in->read((char*)header, 1) != 1)
+		return false;
+	UInt64 size;
+	UInt32 dic;
+	if (header[0] == LZMA2_HEADER_MARK) {
+		if (in->read((char*)header + 1, LZMA2_HEADER_SIZE - 1) != LZMA2_HEADER_SIZE - 1 || header[1] > 40)
+			return false;
+		*format = Lzma2;
+		size = readSize(header + LZMA2_SIZE_OFFSET);
+		dic = header[1] == 40 ? 0xFFFFFFFF : (2 | (header[1] & 1)) << (header[1] / 2 + 11);
+	} else if (header[0] == 0) {
+		if (in->read((char*)header + 1, LZMA86_HEADER_SIZE - 1) != LZMA86_HEADER_SIZE - 1 || header[1] >= 9 * 5 * 5)
+			return false;
+		*format = Lzma86;
+		size = readLzma86Size(header);
+		dic = header[2] | ((UInt32)header[3] << 8) | ((UInt32)header[4] << 16) | ((UInt32)header[5] << 24);
+	} else {
+		return false;
+	}
+	if (unpackSize)
+		*unpackSize = size == LZMA86_SIZE_UNKNOWN ? -1 : (qint64)size;
+	if (dictSize)
+		*dictSize = dic;
+	return true;
+}
+
+/*!
+	Decodes the lzma86 or lzma2 stream written by compressData()/compressStream() from in to out.
+	The first byte tells the format.
+*/
+int QLzma::extractStream(QIODevice *in, QIODevice *out)
+{
+	Q_D(QLzma);
+	QLzmaProgressScope scope(&d->counter);
+	QLzmaAllocStatsScope allocScope(&d->alloc_counter);
+	Byte header[LZMA86_HEADER_SIZE];
+	if (in->read((char*)header, 1) != 1)
+		return SZ_ERROR_INPUT_EOF;
+	int res;
+	if (header[0] == LZMA2_HEADER_MARK) {
+		if (in->read((char*)header + 1, LZMA2_HEADER_SIZE - 1) != LZMA2_HEADER_SIZE - 1)
+			return SZ_ERROR_INPUT_EOF;
+		UInt64 unpackSize = readSize(header + LZMA2_SIZE_OFFSET);
+		QFile *inFile = qobject_cast<QFile*>(in);
+		QFile *outFile = qobject_cast<QFile*>(out);
+		if (d->numThreads() > 1 && inFile && outFile && d->decodeLzma2Mapped(inFile, outFile, header[1], unpackSize, &res))
+			return res;
+		CLzma2Dec dec;
+		Lzma2Dec_Construct(&dec);
+		res = Lzma2Dec_AllocateProbs(&dec, header[1], smallAlloc());
+		if (res != SZ_OK)
+			return res;
+		Lzma2Dec_Init(&dec);
+		res = d->decode(&dec, in, out, unpackSize, LZMA2_HEADER_SIZE);
+		freeDecoder(&dec);
+		return res;
+	}
+	if (header[0] != 0) //x86 filter is not supported
+		return SZ_ERROR_UNSUPPORTED;
+	if (in->read((char*)header + 1, LZMA86_HEADER_SIZE - 1) != LZMA86_HEADER_SIZE - 1)
+		return SZ_ERROR_INPUT_EOF;
+	CLzmaDec dec;
+	LzmaDec_Construct(&dec);
+	res = LzmaDec_AllocateProbs(&dec, header + 1, LZMA_PROPS_SIZE, smallAlloc());
+	if (res != SZ_OK)
+		return res;
+	LzmaDec_Init(&dec);
+	UInt64 unpackSize = readLzma86Size(header);
+	//decode straight into the output file if the size is known
+	QFile *outFile = qobject_cast<QFile*>(out);
+	qint64 outPos = outFile ? outFile->pos() : 0;
+	uchar *outBuf = outFile ? mapOutput(outFile, unpackSize) : 0;
+	res = d->decode(&dec, in, out, unpackSize, LZMA86_HEADER_SIZE, outBuf);
+	if (outBuf) {
+		outFile->unmap(outBuf);
+		if (dec.dicPos != unpackSize)
+			outFile->resize(outPos + dec.dicPos);
+		outFile->seek(outPos + dec.dicPos);
+	}
+	freeDecoder(&dec);
+	return res;
+}
+
+/*!
+	Block-parallel LZMA2 decoding. Both files are mapped and every block is decoded by Lzma2DecodeMt
+	straight to its offset in the output file.
+	Returns false if it's not possible (unknown size, the files can not be mapped...), then nothing
+	is read or written and the stream should be decoded sequentially.
+	The header size is not trusted: the chunk headers must add up to it before the output is extended,
+	and the output is cut back to what was decoded on error.
+*/
+bool QLzmaPrivate::decodeLzma2Mapped(QFile *in, QFile *out, Byte prop, UInt64 unpackSize, int *res)
+{
+	if (unpackSize == LZMA86_SIZE_UNKNOWN || unpackSize == 0)
+		return false;
+	qint64 inPos = in->pos(), outPos = out->pos();
+	qint64 inSize = in->size() - inPos;
+	if (inSize <= 0 || (UInt64)(SizeT)inSize != (UInt64)inSize)
+		return false;
+	uchar *src = in->map(inPos, inSize);
+	if (!src)
+		return false;
+	SizeT srcLen = (SizeT)inSize, numBlocks = 0, packSize;
+	UInt64 blocksSize;
+	*res = Lzma2Dec_FindBlocks(src, srcLen, NULL, &numBlocks, &blocksSize, &packSize);
+	if (*res == SZ_OK && blocksSize != unpackSize)
+		*res = SZ_ERROR_DATA;
+	uchar *dest = *res == SZ_OK ? mapOutput(out, unpackSize) : 0;
+	if (!dest) {
+		in->unmap(src);
+		return *res != SZ_OK;
+	}
+	SizeT destLen = (SizeT)unpackSize;
+	*res = Lzma2DecodeMt(dest, &destLen, src, &srcLen, prop, numThreads(), progressCallBack, smallAlloc());
+	if (*res == SZ_OK && destLen != unpackSize)
+		*res = SZ_ERROR_DATA;
+	out->unmap(dest);
+	in->unmap(src);
+	if (destLen != unpackSize)
+		out->resize(outPos + destLen);
+	in->seek(inPos + srcLen);
+	out->seek(outPos + destLen);
+	return true;
+}
+
+/*!
+	LzmaDec_DecodeToDic/Lzma2Dec_DecodeToDic decode into the dictionary and the new bytes are written out
+	from there, so the memory is the dictionary (or the unpacked size if it's smaller) plus the input buffer.
+	dec must have the probs allocated and be initialized. The dictionary is allocated here and freed with dec.
+	If outBuf is not null, it has unpackSize bytes (e.g. the mapped output file) and is used as the
+	dictionary instead: nothing is written to out, and dicPos is the decoded size when it returns.
+*/
+template<typename Decoder>
+int QLzmaPrivate::decode(Decoder *dec, QIODevice *in, QIODevice *out, UInt64 unpackSize, UInt64 inProcessed, Byte *outBuf)
+{
+	CLzmaDec *lz = lzmaDecoder(dec);
+	bool sizeDefined = unpackSize != LZMA86_SIZE_UNKNOWN;
+	if (outBuf) {
+		lz->dicBufSize = (SizeT)unpackSize;
+		lz->dic = outBuf;
+	} else {
+		//a small file does not need the whole dictionary
+		lz->dicBufSize = lz->prop.dicSize;
+		if (sizeDefined && unpackSize < lz->dicBufSize)
+			lz->dicBufSize = unpackSize > 0 ? (SizeT)unpackSize : 1;
+		lz->dic = (Byte*)bigAlloc()->Alloc(bigAlloc(), lz->dicBufSize);
+	}
+	Byte *inBuf = (Byte*)smallAlloc()->Alloc(smallAlloc(), LZMA_IN_BUF_SIZE);
+	if (!lz->dic || !inBuf) {
+		smallAlloc()->Free(smallAlloc(), inBuf);
+		if (outBuf)
+			lz->dic = 0;
+		return SZ_ERROR_MEM;
+	}
+
+	int res = SZ_OK;
+	UInt64 outProcessed = 0;
+	size_t inPos = 0, inSize = 0;
+	for (;;) {
+		if (inPos == inSize) {
+			qint64 n = in->read((char*)inBuf, LZMA_IN_BUF_SIZE);
+			if (n < 0) {
+				res = SZ_ERROR_READ;
+				break;
+			}
+			inSize = n;
+			inPos = 0;
+		}
+		SizeT dicPos = lz->dicPos;
+		SizeT dicLimit = lz->dicBufSize;
+		ELzmaFinishMode finishMode = LZMA_FINISH_ANY;
+		if (sizeDefined && unpackSize - outProcessed <= dicLimit - dicPos) {
+			dicLimit = dicPos + (SizeT)(unpackSize - outProcessed);
+			finishMode = LZMA_FINISH_END;
+		}
+		SizeT inLen = inSize - inPos;
+		ELzmaStatus status;
+		res = decodeToDic(dec, dicLimit, inBuf + inPos, &inLen, finishMode, &status);
+		inPos += inLen;
+		inProcessed += inLen;
+		SizeT outLen = lz->dicPos - dicPos;
+		if (outLen > 0 && !outBuf && out->write((const char*)lz->dic + dicPos, outLen) != (qint64)outLen) {
+			res = SZ_ERROR_WRITE;
+			break;
+		}
+		outProcessed += outLen;
+		if (lz->dicPos == lz->dicBufSize && !outBuf)
+			lz->dicPos = 0;
+		if (res != SZ_OK)
+			break;
+		if (progressCallBack->Progress(progressCallBack, inProcessed, outProcessed) != SZ_OK) {
+			res = SZ_ERROR_PROGRESS;
+			break;
+		}
+		if (status == LZMA_STATUS_FINISHED_WITH_MARK) {
+			if (sizeDefined && outProcessed != unpackSize)
+				res = SZ_ERROR_DATA;
+			break;
+		}
+		if (sizeDefined && outProcessed == unpackSize)
+			break;
+		if (inLen == 0 && outLen == 0) { //no more input
+			res = SZ_ERROR_INPUT_EOF;
+			break;
+		}
+	}
+	smallAlloc()->Free(smallAlloc(), inBuf);
+	if (outBuf)
+		lz->dic = 0; //not ours
+	return res;
+}
+
+/*!
+	Extracts in a worker thread and returns immediately. finished() is emitted when done
+*/
+void QLzma::extract()
+{
+	Q_D(QLzma);
+	if (d->isRunning()) {
+		qWarning("QLzma is busy");
+		return;
+	}
+	d->compress_mode = false;
+	d->prepareNames();
+	d->startJob(this);
 }
 
 void QLzma::pauseOrResume()
 {
 	Q_D(QLzma);
-	d->pause = !d->pause;
-	if(!d->pause) {
-		d->last_elapsed = d->elapsed;
-		d->time.restart();
+	if(d->pause) {
 		resume();
 	} else {
 		pause();
 	}
 }
 
+//The worker waits in the progress callback while paused
 void QLzma::pause()
 {
 	Q_D(QLzma);
-	while(d->pause) {
-		QT_UTIL::qWait(100);
-	}
+	d->setPaused(true);
 }
 
 void QLzma::resume()
 {
-
+	Q_D(QLzma);
+	if (!d->pause)
+		return;
+	d->last_elapsed = d->elapsed;
+	d->time.restart();
+	d->setPaused(false);
 }
 
+/*!
+	Cancels the running job. The encoder/decoder returns SZ_ERROR_PROGRESS from the next progress
+	callback, then the incomplete output is removed and canceled() is emitted
+*/
 void QLzma::stop()
 {
 	Q_D(QLzma);
-    if (d_ptr) {
-        delete d_ptr;
-        d_ptr = 0;
+	if (!d->isRunning()) {
+		emit canceled();
+		return;
 	}
-	qApp->quit();
+	d->cancel();
 }
 
-void QLzma::timerEvent(QTimerEvent *)
+void QLzma::timerEvent(QTimerEvent *e)
 {
-
+	Q_D(QLzma);
+	if (e->timerId() != d->tid)
+		return;
+	if (!d->worker->isFinished()) {
+		d->updateGui();
+		return;
+	}
+	d->finishJob();
+	if (d->abort) {
+		emit canceled();
+		return;
+	}
+	d->showFinish();
+	emit finished();
 }
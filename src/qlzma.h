@@ -2,33 +2,125 @@
 #define QLZMA_H
 
 #include <qobject.h>
+#include <qbytearray.h>
+#include "qlzmaalloc.h"
+#include "lzma/C/LzmaEnc.h"
 
+class QIODevice;
+struct QLzmaMemoryPlan;
 
 class QLzmaPrivate;
 class QLzma : public QObject
 {
 	Q_OBJECT
 public:
+	enum Format {
+		Lzma86, //lzma86 header + LZMA stream
+		Lzma2   //lzma2 header + LZMA2 chunks
+	};
+
 	QLzma();
 	QLzma(const QString& in);
 	QLzma(const QString& in, const QString& out);
 	~QLzma();
 
 	/*!
-		TODO: can be stdin, stdout
+		For compress()/extract(). Use compressStream()/extractStream() for stdin and stdout
 	*/
 	void setUncompressedFile(const QString& file);
 	void setCompressedFile(const QString& file);
+	/*!
+		0..9 (default 7), or -1 and -2: the fast levels. They take the first match a one entry hash
+		finds and pass incompressible data through with few searches, for speed over ratio
+	*/
 	void setLevel(int level);
+	/*!
+		Number of threads the encoder may use. 0 (default) means QThread::idealThreadCount().
+		LZMA uses at most 2 (the match finder runs in its own thread). Has no effect if the
+		lzma library is built with CONFIG += lzma-st
+	*/
+	void setThreads(int threads);
+	int threads() const;
+	/*!
+		Format used by compress()/compressStream(). compressData() always writes lzma86.
+		extract() detects the format from the header
+	*/
+	void setFormat(Format format);
+	Format format() const;
+	/*!
+		LZMA2 only. The input is split into blocks of this size which are compressed
+		independently (each one starts with a dictionary reset). 0 (default): 4 * dictSize, at least 1 MB
+	*/
+	void setBlockSize(size_t size);
+	size_t blockSize() const;
+	/*!
+		LZMA2 only. Appends the block offsets after the stream, so readAt() does not need to walk the chunks
+	*/
+	void setSeekIndex(bool enable);
+	bool seekIndex() const;
+	/*!
+		Upper bound of the encoder memory. compressStream()/compressData() then take the props of
+		memoryPlan() for the input size: a smaller dictionary, fewer threads... 0 (default): no limit,
+		the level and dictSize are used as they are
+	*/
+	void setMemoryLimit(quint64 bytes);
+	quint64 memoryLimit() const;
+	/*!
+		The props for this input (size < 0: unknown) with the current format, threads and memoryLimit(),
+		and the memory the encoder and the decoder will take. dictSize 0: the level's
+	*/
+	QLzmaMemoryPlan memoryPlan(qint64 inputSize, int level = 7, unsigned int dictSize = 0) const;
+	/*!
+		Decodes len bytes at the uncompressed offset of an LZMA2 compressed file. Only the blocks
+		covering the range are decoded. Returns an empty array on error
+	*/
+	QByteArray readAt(quint64 offset, size_t len);
 
-	int compressData(const unsigned char* data, size_t len, unsigned char *outBuf, size_t* destLen, int level=7, unsigned int dictSize=1 << 16 /*64kb*/);//char* data_out);
-	//void extract();
+	/*!
+		dictSize 0: the level's (64 MB for 7..9). The dictionary and the match finder tables are never
+		made bigger than the input, so a small input does not pay for the allocation of a big dictionary
+	*/
+	int compressData(const unsigned char* data, size_t len, unsigned char *outBuf, size_t* destLen, int level=7, unsigned int dictSize=0);//char* data_out);
+	//size < 0: unknown size, e.g. stdin. The dictionary is then not reduced
+	int compressStream(QIODevice* in, QIODevice* out, qint64 size = -1, int level=7, unsigned int dictSize=0);
+	int extractStream(QIODevice* in, QIODevice* out);
+	/*!
+		Solid compression: dir is read as a tar stream (see QTarArchiver) which goes straight
+		to the encoder, so similar small files share one dictionary and no .tar is written.
+		The result is a .tar.lzma; extractStream() gives back the .tar
+	*/
+	int compressDirectory(const QString& dir, QIODevice* out, int level=7, unsigned int dictSize=0);
+	//Decodes a stream written by compressDirectory() and unpacks the tar into dir on the fly
+	int extractDirectory(QIODevice* in, const QString& dir);
+	/*!
+		Reads the lzma86/lzma2 header at the current position of in. unpackSize is -1 if unknown.
+		Returns false if it is not a header written by QLzma
+	*/
+	static bool readHeader(QIODevice* in, Format* format, qint64* unpackSize = 0, quint32* dictSize = 0);
 
+	/*!
+		The bytes read and written so far by the running compressStream()/extractStream(),
+		0 if none is running. Can be called from any thread
+	*/
+	void progress(quint64* inSize, quint64* outSize = 0) const;
+	/*!
+		The memory the lzma library got from QLzmaAllocator during the last (or the running)
+		compressStream()/extractStream()/compressData(). A reused encoder (see QLzmaEncoderPool)
+		allocates nothing. Can be called from any thread
+	*/
+	QLzmaAllocStats allocStats() const;
+	/*!
+		What the encoder of the last compressStream()/compressData() did: searches, chain depth,
+		parse lengths, literals/matches/reps... (LZMA2: all the blocks). False if the lzma library
+		is built without LZMA_ENC_STATS (CONFIG += lzma-stats)
+	*/
+	bool encoderStats(CLzmaEncStats* stats) const;
 	size_t packSize() const;
 	size_t unpackSize() const;
 
 signals:
 	void finished();
+	void canceled();
 
 public slots:
 	void compress();
@@ -7,6 +7,13 @@ INCLUDEPATH += . ..
 
 SOURCES += main.cpp\
     qlzma.cpp \
+    qlzmastream.cpp \
+    qlzmaindex.cpp \
+    qlzmabatch.cpp \
+    qlzmaencoder.cpp \
+    qlzmaalloc.cpp \
+    qlzmaplan.cpp \
+    qtar.cpp \
     gui/ezprogressdialog.cpp \
     utils/convert.cpp \
     utils/qt_util.cpp \
@@ -14,6 +21,13 @@ SOURCES += main.cpp\
 
 HEADERS  += \
     qlzma.h \
+    qlzmastream.h \
+    qlzmaindex.h \
+    qlzmabatch.h \
+    qlzmaencoder.h \
+    qlzmaalloc.h \
+    qlzmaplan.h \
+    qtar.h \
     qtcompat.h \
     gui/ezprogressdialog_p.h \
     gui/ezprogressdialog.h \
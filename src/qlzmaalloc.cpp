@@ -0,0 +1,295 @@
+/******************************************************************************
+	QLzmaAllocator: the memory allocators of the lzma coders
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+
+#include "qlzmaalloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <qatomic.h>
+#include <qthreadstorage.h>
+#include "lzma/C/Alloc.h"
+
+//threadCache() blocks: 1 << kMinClass ... 1 << kMaxClass bytes including the header
+#define kMinClass 6
+#define kMaxClass 20
+#define kNumClasses (kMaxClass - kMinClass + 1)
+//freed bytes a thread keeps at most
+#define kCacheLimit ((size_t)16 << 20)
+
+struct CacheHeader
+{
+	size_t cls; //0: too big for the cache, from malloc
+	CacheHeader *next;
+};
+
+//the freed blocks of a thread and the counter of its QLzmaAllocStatsScope
+class ThreadData
+{
+public:
+	ThreadData():cached(0),counter(0) { memset(free_list, 0, sizeof(free_list)); }
+	~ThreadData() {
+		for (int i = 0; i < kNumClasses; ++i) {
+			while (free_list[i]) {
+				CacheHeader *h = free_list[i];
+				free_list[i] = h->next;
+				free(h);
+			}
+		}
+	}
+	CacheHeader *free_list[kNumClasses];
+	size_t cached;
+	QLzmaAllocCounter *counter;
+};
+
+//both are 0 once destroyed at exit, the pooled encoders may still free their blocks then
+Q_GLOBAL_STATIC(QThreadStorage<ThreadData*>, threadStorage)
+Q_GLOBAL_STATIC(QLzmaAllocCounter, globalCounter)
+
+static ThreadData* threadData(bool create)
+{
+	QThreadStorage<ThreadData*> *storage = threadStorage();
+	if (!storage)
+		return 0;
+	ThreadData *t = storage->localData();
+	if (!t && create) {
+		t = new ThreadData;
+		storage->setLocalData(t);
+	}
+	return t;
+}
+
+static void *CacheAlloc(void *p, size_t size)
+{
+	Q_UNUSED(p);
+	if (size == 0)
+		return 0;
+	size_t need = size + sizeof(CacheHeader);
+	if (need < size)
+		return 0;
+	CacheHeader *h = 0;
+	if (need > ((size_t)1 << kMaxClass)) {
+		h = (CacheHeader*)malloc(need);
+		if (!h)
+			return 0;
+		h->cls = 0;
+		return h + 1;
+	}
+	size_t cls = kMinClass;
+	while (((size_t)1 << cls) < need)
+		++cls;
+	ThreadData *t = threadData(false);
+	if (t && t->free_list[cls - kMinClass]) {
+		h = t->free_list[cls - kMinClass];
+		t->free_list[cls - kMinClass] = h->next;
+		t->cached -= (size_t)1 << cls;
+	} else {
+		h = (CacheHeader*)malloc((size_t)1 << cls);
+		if (!h)
+			return 0;
+		h->cls = cls;
+	}
+	return h + 1;
+}
+
+//the block goes to the cache of the thread which frees it
+static void CacheFree(void *p, void *address)
+{
+	Q_UNUSED(p);
+	if (!address)
+		return;
+	CacheHeader *h = (CacheHeader*)address - 1;
+	ThreadData *t = 0;
+	if (h->cls != 0)
+		t = threadData(true);
+	if (!t || t->cached + ((size_t)1 << h->cls) > kCacheLimit) {
+		free(h);
+		return;
+	}
+	h->next = t->free_list[h->cls - kMinClass];
+	t->free_list[h->cls - kMinClass] = h;
+	t->cached += (size_t)1 << h->cls;
+}
+
+static void *HeapAlloc(void *p, size_t size) { Q_UNUSED(p); return malloc(size); }
+static void HeapFree(void *p, void *address) { Q_UNUSED(p); free(address); }
+static void *BigPagesAlloc(void *p, size_t size) { Q_UNUSED(p); return BigAlloc(size); }
+static void BigPagesFree(void *p, void *address) { Q_UNUSED(p); BigFree(address); }
+
+static ISzAlloc heapAlloc = { &HeapAlloc, &HeapFree };
+static ISzAlloc cacheAlloc = { &CacheAlloc, &CacheFree };
+static ISzAlloc bigPagesAlloc = { &BigPagesAlloc, &BigPagesFree };
+
+static QLzmaAllocator::Hook alloc_hook = 0;
+
+//in front of every block of get(): where it comes from, for free() and the stats
+struct BlockHeader
+{
+	ISzAlloc *base;
+	size_t size;
+};
+
+class CountingAlloc : public ISzAlloc
+{
+public:
+	CountingAlloc(QLzmaAllocator::Kind k, ISzAlloc *defaultAlloc, size_t header)
+		:kind(k),default_alloc(defaultAlloc),header_size(header) {
+		Alloc = &CountingAlloc::allocBlock;
+		Free = &CountingAlloc::freeBlock;
+	}
+	void setBase(ISzAlloc *alloc) { base.fetchAndStoreOrdered(alloc ? alloc : default_alloc); }
+	ISzAlloc* currentBase() {
+		ISzAlloc *b = base.fetchAndAddOrdered(0);
+		return b ? b : default_alloc;
+	}
+
+private:
+	static void count(QLzmaAllocator::Kind kind, void *address, qint64 size) {
+		QLzmaAllocCounter *global = globalCounter();
+		if (global)
+			global->add(size);
+		ThreadData *t = threadData(false);
+		if (t && t->counter)
+			t->counter->add(size);
+		QLzmaAllocator::Hook hook = alloc_hook;
+		if (hook)
+			hook(kind, address, size);
+	}
+	static void *allocBlock(void *p, size_t size) {
+		CountingAlloc *a = static_cast<CountingAlloc*>((ISzAlloc*)p);
+		if (size == 0 || size + a->header_size < size)
+			return 0;
+		ISzAlloc *b = a->currentBase();
+		Byte *block = (Byte*)b->Alloc(b, size + a->header_size);
+		if (!block)
+			return 0;
+		BlockHeader *h = (BlockHeader*)block;
+		h->base = b;
+		h->size = size;
+		count(a->kind, block + a->header_size, (qint64)size);
+		return block + a->header_size;
+	}
+	static void freeBlock(void *p, void *address) {
+		if (!address)
+			return;
+		CountingAlloc *a = static_cast<CountingAlloc*>((ISzAlloc*)p);
+		Byte *block = (Byte*)address - a->header_size;
+		BlockHeader *h = (BlockHeader*)block;
+		count(a->kind, address, -(qint64)h->size);
+		h->base->Free(h->base, block);
+	}
+
+	QLzmaAllocator::Kind kind;
+	ISzAlloc *default_alloc;
+	size_t header_size; //16 keeps the malloc alignment, 64 the cache line alignment of the big blocks
+	QAtomicPointer<ISzAlloc> base;
+};
+
+static CountingAlloc smallAlloc(QLzmaAllocator::Small, &cacheAlloc, 16);
+static CountingAlloc bigAlloc(QLzmaAllocator::Big, &bigPagesAlloc, 64);
+
+ISzAlloc* QLzmaAllocator::get(Kind kind)
+{
+	return kind == Big ? &bigAlloc : &smallAlloc;
+}
+
+void QLzmaAllocator::setAllocator(Kind kind, ISzAlloc *alloc)
+{
+	if (kind == Big)
+		bigAlloc.setBase(alloc);
+	else
+		smallAlloc.setBase(alloc);
+}
+
+ISzAlloc* QLzmaAllocator::heap()
+{
+	return &heapAlloc;
+}
+
+ISzAlloc* QLzmaAllocator::threadCache()
+{
+	return &cacheAlloc;
+}
+
+ISzAlloc* QLzmaAllocator::bigPages()
+{
+	return &bigPagesAlloc;
+}
+
+void QLzmaAllocator::enableLargePages()
+{
+#if defined(Q_OS_WIN) || defined(Q_OS_LINUX)
+	SetLargePageSize();
+#endif
+}
+
+void QLzmaAllocator::setHook(Hook hook)
+{
+	alloc_hook = hook;
+}
+
+QLzmaAllocStats QLzmaAllocator::globalStats()
+{
+	QLzmaAllocCounter *global = globalCounter();
+	return global ? global->stats() : QLzmaAllocStats();
+}
+
+
+void QLzmaAllocCounter::add(qint64 size)
+{
+	QMutexLocker lock(&mutex);
+	if (size > 0) {
+		++s.allocations;
+		s.allocatedBytes += size;
+	}
+	s.bytesInUse += size;
+	if (s.bytesInUse > s.peakBytes)
+		s.peakBytes = s.bytesInUse;
+}
+
+void QLzmaAllocCounter::reset()
+{
+	QMutexLocker lock(&mutex);
+	s = QLzmaAllocStats();
+}
+
+QLzmaAllocStats QLzmaAllocCounter::stats() const
+{
+	QMutexLocker lock(&mutex);
+	return s;
+}
+
+
+QLzmaAllocStatsScope::QLzmaAllocStatsScope(QLzmaAllocCounter *counter)
+	:prev(0)
+{
+	counter->reset();
+	ThreadData *t = threadData(true);
+	if (t) {
+		prev = t->counter;
+		t->counter = counter;
+	}
+}
+
+QLzmaAllocStatsScope::~QLzmaAllocStatsScope()
+{
+	ThreadData *t = threadData(false);
+	if (t)
+		t->counter = prev;
+}
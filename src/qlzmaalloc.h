@@ -0,0 +1,97 @@
+/******************************************************************************
+	QLzmaAllocator: the memory allocators of the lzma coders
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+#ifndef QLZMAALLOC_H
+#define QLZMAALLOC_H
+
+#include <qglobal.h>
+#include <qmutex.h>
+#include "lzma/C/Types.h"
+
+struct QLzmaAllocStats
+{
+	QLzmaAllocStats():allocations(0),allocatedBytes(0),bytesInUse(0),peakBytes(0) {}
+	quint64 allocations;
+	quint64 allocatedBytes; //sum of all the allocations
+	/*!
+		In a QLzmaAllocStatsScope: relative to the start of the scope, so it is negative if
+		the scope frees more than it allocates (e.g. an encoder from QLzmaEncoderPool is resized)
+	*/
+	qint64 bytesInUse;
+	qint64 peakBytes;
+};
+
+/*!
+	The ISzAlloc's the lzma library gets from QLzma and QLzmaEncoder.
+	Small: the coder states (CLzmaEnc, probs, stream buffers). The default is a per-thread cache of
+	freed blocks in front of malloc, so the coders of a batch get their state back without the heap.
+	Big: the match finder (window, hash, son) and the decoder dictionary. The default is BigAlloc(),
+	which maps them on 2 MB boundaries with transparent huge pages on Linux, fewer TLB misses in the
+	binary tree of a 64 MB dictionary.
+	Every block remembers the allocator it comes from, so setAllocator() can be called any time.
+*/
+class QLzmaAllocator
+{
+public:
+	enum Kind { Small, Big };
+	//size > 0: allocated, size < 0: freed. Called from the coder threads
+	typedef void (*Hook)(Kind kind, void *address, qint64 size);
+
+	//what the coders use: counts the blocks and forwards to the allocator of this kind
+	static ISzAlloc* get(Kind kind);
+	//0 restores the default
+	static void setAllocator(Kind kind, ISzAlloc *alloc);
+	static ISzAlloc* heap(); //malloc/free
+	static ISzAlloc* threadCache();
+	static ISzAlloc* bigPages(); //BigAlloc/BigFree
+	/*!
+		bigPages() tries MAP_HUGETLB (Linux, needs vm.nr_hugepages) or large pages (Windows,
+		needs SeLockMemoryPrivilege) before the normal pages. Call it before the coders run
+	*/
+	static void enableLargePages();
+	static void setHook(Hook hook);
+	//all the blocks of all the threads
+	static QLzmaAllocStats globalStats();
+};
+
+//thread safe QLzmaAllocStats
+class QLzmaAllocCounter
+{
+public:
+	void add(qint64 size);
+	void reset();
+	QLzmaAllocStats stats() const;
+private:
+	mutable QMutex mutex;
+	QLzmaAllocStats s;
+};
+
+//counts the allocations of the current thread into counter (reset first) while it lives
+class QLzmaAllocStatsScope
+{
+public:
+	QLzmaAllocStatsScope(QLzmaAllocCounter *counter);
+	~QLzmaAllocStatsScope();
+private:
+	Q_DISABLE_COPY(QLzmaAllocStatsScope)
+	QLzmaAllocCounter *prev;
+};
+
+#endif // QLZMAALLOC_H
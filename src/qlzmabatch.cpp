@@ -0,0 +1,343 @@
+/******************************************************************************
+	QLzmaBatch: compresses many files on a pool of threads
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+#include "qlzmabatch.h"
+#include <algorithm>
+#include <qatomic.h>
+#include <qdir.h>
+#include <qdiriterator.h>
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qmutex.h>
+#include <qthread.h>
+#include "lzma/C/Types.h"
+
+struct QLzmaJob
+{
+	QString in, out;
+	qint64 size;
+	bool operator<(const QLzmaJob& other) const { return size > other.size; } //biggest first
+};
+
+class QLzmaBatchWorker;
+class QLzmaBatchPrivate
+{
+	Q_DECLARE_PUBLIC(QLzmaBatch)
+public:
+	QLzmaBatchPrivate()
+		:q_ptr(0),level(7),dictSize(0),format(QLzma::Lzma86),blockSize(0),seekIndex(false),threads(0),memoryLimit(0)
+		,total(0),stop(false),done(0),last(0)
+	{}
+
+	~QLzmaBatchPrivate() {
+		stop = true;
+		wait();
+	}
+
+	void addJob(const QString& in, const QString& out, qint64 size) {
+		QLzmaJob job;
+		job.in = in;
+		job.out = out;
+		job.size = size;
+		jobs.append(job);
+		total += size;
+	}
+
+	QString outputPath(const QString& file, const QString& relative) const {
+		if (out_dir.isEmpty())
+			return file + ".lzma";
+		return QDir(out_dir).filePath(relative + ".lzma");
+	}
+
+	void start();
+	void wait();
+	void runJobs(QLzma *lzma);
+	int compress(QLzma *lzma, const QLzmaJob& job);
+
+	QLzmaBatch *q_ptr;
+	QList<QLzmaJob> jobs;
+	QString out_dir;
+	int level;
+	unsigned int dictSize;
+	QLzma::Format format;
+	size_t blockSize;
+	bool seekIndex;
+	int threads; //0: auto
+	quint64 memoryLimit; //all the workers
+	qint64 total;
+
+	QList<QLzmaBatchWorker*> workers;
+	QAtomicInt next; //the next job to start
+	QAtomicInt running; //workers
+	volatile bool stop;
+	mutable QMutex mutex; //done, last, failed
+	qint64 done; //bytes of the finished files
+	mutable qint64 last; //processedSize() never goes back
+	QStringList failed;
+};
+
+class QLzmaBatchWorker : public QThread
+{
+public:
+	QLzmaBatchWorker(QLzmaBatchPrivate *d):d(d) {
+		lzma.setThreads(1);
+		lzma.setFormat(d->format);
+		lzma.setBlockSize(d->blockSize);
+		lzma.setSeekIndex(d->seekIndex);
+	}
+	QLzma lzma;
+protected:
+	void run() { d->runJobs(&lzma); }
+private:
+	QLzmaBatchPrivate *d;
+};
+
+void QLzmaBatchPrivate::start()
+{
+	std::stable_sort(jobs.begin(), jobs.end());
+	next = 0;
+	stop = false;
+	done = 0;
+	last = 0;
+	failed.clear();
+	int n = threads > 0 ? threads : qMax(1, QThread::idealThreadCount());
+	n = qMin(n, jobs.size());
+	running = n;
+	for (int i = 0; i < n; ++i) {
+		QLzmaBatchWorker *worker = new QLzmaBatchWorker(this);
+		worker->lzma.setMemoryLimit(memoryLimit / qMax(1, n));
+		workers.append(worker);
+	}
+	for (int i = 0; i < n; ++i)
+		workers.at(i)->start();
+	if (n == 0)
+		emit q_ptr->finished();
+}
+
+void QLzmaBatchPrivate::wait()
+{
+	for (int i = 0; i < workers.size(); ++i) {
+		workers.at(i)->wait();
+		delete workers.at(i);
+	}
+	workers.clear();
+}
+
+//Called in the worker threads
+void QLzmaBatchPrivate::runJobs(QLzma *lzma)
+{
+	for (;;) {
+		int i = next.fetchAndAddOrdered(1);
+		if (stop || i >= jobs.size())
+			break;
+		const QLzmaJob& job = jobs.at(i);
+		int res = compress(lzma, job);
+		{
+			QMutexLocker lock(&mutex);
+			done += job.size;
+			if (res != SZ_OK)
+				failed.append(job.in);
+		}
+		emit q_ptr->fileFinished(job.in, res);
+	}
+	if (!running.deref()) //the last one
+		emit q_ptr->finished();
+}
+
+int QLzmaBatchPrivate::compress(QLzma *lzma, const QLzmaJob &job)
+{
+	QFile in(job.in);
+	if (!in.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+		qWarning("Failed to open %s: %s", qPrintable(job.in), qPrintable(in.errorString()));
+		return SZ_ERROR_READ;
+	}
+	QDir().mkpath(QFileInfo(job.out).absolutePath());
+	QFile out(job.out);
+	if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+		qWarning("Failed to open %s: %s", qPrintable(job.out), qPrintable(out.errorString()));
+		return SZ_ERROR_WRITE;
+	}
+	int res = lzma->compressStream(&in, &out, in.size(), level, dictSize);
+	if (res != SZ_OK) {
+		qWarning("Compress %s error(%d)", qPrintable(job.in), res);
+		out.remove();
+	}
+	return res;
+}
+
+
+QLzmaBatch::QLzmaBatch(QObject *parent)
+	:QObject(parent),d_ptr(new QLzmaBatchPrivate())
+{
+	d_ptr->q_ptr = this;
+}
+
+QLzmaBatch::~QLzmaBatch()
+{
+	if (d_ptr) {
+		delete d_ptr;
+		d_ptr = 0;
+	}
+}
+
+void QLzmaBatch::addFile(const QString &file, const QString &out)
+{
+	Q_D(QLzmaBatch);
+	QFileInfo fi(file);
+	d->addJob(fi.absoluteFilePath(), out.isEmpty() ? d->outputPath(fi.absoluteFilePath(), fi.fileName()) : out, fi.size());
+}
+
+void QLzmaBatch::addDirectory(const QString &dir)
+{
+	Q_D(QLzmaBatch);
+	QDir root(dir);
+	QDirIterator it(root.absolutePath(), QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+	while (it.hasNext()) {
+		QString file = it.next();
+		if (file.endsWith(".lzma"))
+			continue;
+		d->addJob(file, d->outputPath(file, root.relativeFilePath(file)), it.fileInfo().size());
+	}
+}
+
+int QLzmaBatch::count() const
+{
+	Q_D(const QLzmaBatch);
+	return d->jobs.size();
+}
+
+void QLzmaBatch::clear()
+{
+	Q_D(QLzmaBatch);
+	if (isRunning())
+		return;
+	d->jobs.clear();
+	d->total = 0;
+}
+
+void QLzmaBatch::setOutputDirectory(const QString &dir)
+{
+	Q_D(QLzmaBatch);
+	d->out_dir = dir.isEmpty() ? dir : QDir(dir).absolutePath();
+}
+
+void QLzmaBatch::setLevel(int level)
+{
+	Q_D(QLzmaBatch);
+	d->level = level;
+}
+
+void QLzmaBatch::setDictSize(unsigned int size)
+{
+	Q_D(QLzmaBatch);
+	d->dictSize = size;
+}
+
+void QLzmaBatch::setMemoryLimit(quint64 bytes)
+{
+	Q_D(QLzmaBatch);
+	d->memoryLimit = bytes;
+}
+
+void QLzmaBatch::setFormat(QLzma::Format format)
+{
+	Q_D(QLzmaBatch);
+	d->format = format;
+}
+
+void QLzmaBatch::setBlockSize(size_t size)
+{
+	Q_D(QLzmaBatch);
+	d->blockSize = size;
+}
+
+void QLzmaBatch::setSeekIndex(bool enable)
+{
+	Q_D(QLzmaBatch);
+	d->seekIndex = enable;
+}
+
+void QLzmaBatch::setThreads(int threads)
+{
+	Q_D(QLzmaBatch);
+	d->threads = qMax(0, threads);
+}
+
+void QLzmaBatch::start()
+{
+	Q_D(QLzmaBatch);
+	if (isRunning()) {
+		qWarning("QLzmaBatch is busy");
+		return;
+	}
+	d->wait(); //the workers of the last run
+	d->start();
+}
+
+bool QLzmaBatch::wait()
+{
+	Q_D(QLzmaBatch);
+	d->wait();
+	return failedFiles().isEmpty();
+}
+
+bool QLzmaBatch::isRunning() const
+{
+	Q_D(const QLzmaBatch);
+	for (int i = 0; i < d->workers.size(); ++i) {
+		if (d->workers.at(i)->isRunning())
+			return true;
+	}
+	return false;
+}
+
+void QLzmaBatch::stop()
+{
+	Q_D(QLzmaBatch);
+	d->stop = true;
+}
+
+qint64 QLzmaBatch::totalSize() const
+{
+	Q_D(const QLzmaBatch);
+	return d->total;
+}
+
+qint64 QLzmaBatch::processedSize() const
+{
+	Q_D(const QLzmaBatch);
+	QMutexLocker lock(&d->mutex);
+	qint64 size = d->done;
+	for (int i = 0; i < d->workers.size(); ++i) {
+		quint64 in;
+		d->workers.at(i)->lzma.progress(&in);
+		size += in;
+	}
+	//a worker's progress is reset before its file is added to done
+	d->last = qMax(d->last, size);
+	return d->last;
+}
+
+QStringList QLzmaBatch::failedFiles() const
+{
+	Q_D(const QLzmaBatch);
+	QMutexLocker lock(&d->mutex);
+	return d->failed;
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+	QLzmaBatch: compresses many files on a pool of threads
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+#ifndef QLZMABATCH_H
+#define QLZMABATCH_H
+
+#include <qobject.h>
+#include <qstringlist.h>
+#include "qlzma.h"
+
+class QLzmaBatchPrivate;
+/*!
+	Every file is one lzma86 (or lzma2, see setFormat()) stream, as QLzma::compressStream() writes.
+	Each worker thread compresses one file at a time with a single threaded encoder, so N files are
+	compressed at once on N cores. The encoders (match finder, probs) come from QLzmaEncoderPool and
+	are reused from one file to the next. The biggest files are started first, so the workers finish at about the same time.
+*/
+class QLzmaBatch : public QObject
+{
+	Q_OBJECT
+public:
+	QLzmaBatch(QObject *parent = 0);
+	~QLzmaBatch();
+
+	//out: default is file.lzma, or file.lzma in outputDirectory()
+	void addFile(const QString& file, const QString& out = QString());
+	//All files in dir and its sub directories, except *.lzma
+	void addDirectory(const QString& dir);
+	int count() const;
+	void clear();
+	/*!
+		Where the compressed files are written. The directory structure below a directory
+		added by addDirectory() is kept. Empty (default): next to the input files
+	*/
+	void setOutputDirectory(const QString& dir);
+	void setLevel(int level);
+	//0 (default): the level's, reduced to the size of each file
+	void setDictSize(unsigned int size);
+	void setFormat(QLzma::Format format);
+	//LZMA2 only, see QLzma::setBlockSize() and QLzma::setSeekIndex()
+	void setBlockSize(size_t size);
+	void setSeekIndex(bool enable);
+	//Number of workers. 0 (default) means QThread::idealThreadCount()
+	void setThreads(int threads);
+	//Encoder memory of the whole batch, each worker gets its share (see QLzma::setMemoryLimit()). 0: no limit
+	void setMemoryLimit(quint64 bytes);
+
+	//Starts the workers and returns. finished() is emitted when all files are done
+	void start();
+	//Blocks until all files are done. Returns false if there was an error
+	bool wait();
+	bool isRunning() const;
+	//No more files are started. The running ones are finished
+	void stop();
+
+	//Aggregate progress of all the files, in uncompressed bytes
+	qint64 totalSize() const;
+	qint64 processedSize() const;
+	QStringList failedFiles() const;
+
+signals:
+	void fileFinished(const QString& file, int res);
+	void finished();
+
+protected:
+	Q_DECLARE_PRIVATE(QLzmaBatch)
+	QLzmaBatchPrivate *d_ptr;
+};
+
+#endif // QLZMABATCH_H
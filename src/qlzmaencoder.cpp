@@ -0,0 +1,248 @@
+/******************************************************************************
+	QLzmaEncoder: reusable LZMA encoder and a pool of them
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+#include "qlzmaencoder.h"
+#include <qthread.h>
+#include "qlzmaalloc.h"
+
+//the encoder state, and the match finder which goes to huge pages if possible
+static inline ISzAlloc* smallAlloc() { return QLzmaAllocator::get(QLzmaAllocator::Small); }
+static inline ISzAlloc* bigAlloc() { return QLzmaAllocator::get(QLzmaAllocator::Big); }
+
+QLzmaEncoder::QLzmaEncoder(int level, unsigned int dictSize, int threads)
+	:enc(LzmaEnc_Create(smallAlloc()))
+{
+	setProps(level, dictSize, threads);
+}
+
+QLzmaEncoder::~QLzmaEncoder()
+{
+	if (enc) {
+		LzmaEnc_Destroy(enc, smallAlloc(), bigAlloc());
+		enc = 0;
+	}
+}
+
+QLzmaEncoder::QLzmaEncoder(const CLzmaEncProps &props)
+	:enc(LzmaEnc_Create(smallAlloc()))
+{
+	setProps(props);
+}
+
+void QLzmaEncoder::setProps(int level, unsigned int dictSize, int threads)
+{
+	LzmaEncProps_Init(&enc_props);
+	enc_props.level = level;
+	enc_props.dictSize = dictSize;
+	enc_props.numThreads = threads > 1 ? 2 : 1;
+}
+
+void QLzmaEncoder::setProps(const CLzmaEncProps &props)
+{
+	enc_props = props;
+}
+
+const CLzmaEncProps& QLzmaEncoder::props() const
+{
+	return enc_props;
+}
+
+int QLzmaEncoder::level() const
+{
+	return enc_props.level;
+}
+
+unsigned int QLzmaEncoder::dictSize() const
+{
+	return enc_props.dictSize;
+}
+
+int QLzmaEncoder::threads() const
+{
+	return enc_props.numThreads;
+}
+
+bool QLzmaEncoder::isNull() const
+{
+	return !enc;
+}
+
+void QLzmaEncoder::setEndMark(bool writeEndMark)
+{
+	enc_props.writeEndMark = writeEndMark;
+}
+
+int QLzmaEncoder::writeProperties(Byte *data)
+{
+	if (!enc)
+		return SZ_ERROR_MEM;
+	SizeT size = LZMA_PROPS_SIZE;
+	int res = LzmaEnc_SetProps(enc, &enc_props);
+	if (res == SZ_OK)
+		res = LzmaEnc_WriteProperties(enc, data, &size);
+	return res;
+}
+
+int QLzmaEncoder::encode(Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen, bool writeEndMark, ICompressProgress *progress)
+{
+	if (!enc)
+		return SZ_ERROR_MEM;
+	setEndMark(writeEndMark);
+	int res = LzmaEnc_SetProps(enc, &enc_props);
+	if (res != SZ_OK)
+		return res;
+	return LzmaEnc_MemEncode(enc, dest, destLen, src, srcLen, writeEndMark, progress, smallAlloc(), bigAlloc());
+}
+
+int QLzmaEncoder::encode(ISeqOutStream *out, const Byte *src, SizeT srcLen, bool writeEndMark, ICompressProgress *progress)
+{
+	if (!enc)
+		return SZ_ERROR_MEM;
+	setEndMark(writeEndMark);
+	int res = LzmaEnc_SetProps(enc, &enc_props);
+	if (res != SZ_OK)
+		return res;
+	return LzmaEnc_MemEncodeToStream(enc, out, src, srcLen, progress, smallAlloc(), bigAlloc());
+}
+
+int QLzmaEncoder::encode(ISeqOutStream *out, ISeqInStream *in, bool writeEndMark, ICompressProgress *progress)
+{
+	if (!enc)
+		return SZ_ERROR_MEM;
+	setEndMark(writeEndMark);
+	int res = LzmaEnc_SetProps(enc, &enc_props);
+	if (res != SZ_OK)
+		return res;
+	return LzmaEnc_Encode(enc, out, in, progress, smallAlloc(), bigAlloc());
+}
+
+int QLzmaEncoder::stats(CLzmaEncStats *stats) const
+{
+	if (!enc)
+		return SZ_ERROR_MEM;
+	return LzmaEnc_GetStats(enc, stats);
+}
+
+
+Q_GLOBAL_STATIC(QLzmaEncoderPool, globalPool)
+
+QLzmaEncoderPool* QLzmaEncoderPool::instance()
+{
+	return globalPool();
+}
+
+QLzmaEncoderPool::QLzmaEncoderPool(int maxIdle)
+	:max_idle(maxIdle > 0 ? maxIdle : qMax(1, QThread::idealThreadCount()))
+{}
+
+QLzmaEncoderPool::~QLzmaEncoderPool()
+{
+	clear();
+}
+
+//compares the normalized props: reduceSize only matters through dictSize, writeEndMark not at all
+static bool sameProps(CLzmaEncProps a, CLzmaEncProps b)
+{
+	LzmaEncProps_Normalize(&a);
+	LzmaEncProps_Normalize(&b);
+	return a.level == b.level && a.dictSize == b.dictSize && a.lc == b.lc && a.lp == b.lp && a.pb == b.pb
+			&& a.algo == b.algo && a.fb == b.fb && a.btMode == b.btMode && a.numHashBytes == b.numHashBytes
+			&& a.mc == b.mc && a.numThreads == b.numThreads && a.priceMode == b.priceMode;
+}
+
+QLzmaEncoder* QLzmaEncoderPool::acquire(int level, unsigned int dictSize, int threads)
+{
+	CLzmaEncProps props;
+	LzmaEncProps_Init(&props);
+	props.level = level;
+	props.dictSize = dictSize;
+	props.numThreads = threads > 1 ? 2 : 1;
+	return acquire(props);
+}
+
+QLzmaEncoder* QLzmaEncoderPool::acquire(const CLzmaEncProps &props)
+{
+	QLzmaEncoder *encoder = 0;
+	{
+		QMutexLocker lock(&mutex);
+		for (int i = idle.size() - 1; i >= 0; --i) {
+			if (sameProps(idle.at(i)->props(), props)) {
+				encoder = idle.takeAt(i);
+				break;
+			}
+		}
+		//a different dictionary: LzmaEnc reallocates what does not fit
+		if (!encoder && !idle.isEmpty())
+			encoder = idle.takeLast();
+	}
+	if (encoder) {
+		encoder->setProps(props);
+		return encoder;
+	}
+	encoder = new QLzmaEncoder(props);
+	if (encoder->isNull()) {
+		delete encoder;
+		return 0;
+	}
+	return encoder;
+}
+
+void QLzmaEncoderPool::release(QLzmaEncoder *encoder)
+{
+	if (!encoder)
+		return;
+	{
+		QMutexLocker lock(&mutex);
+		if (idle.size() < max_idle) {
+			idle.append(encoder);
+			return;
+		}
+	}
+	delete encoder;
+}
+
+void QLzmaEncoderPool::setMaxIdle(int count)
+{
+	QList<QLzmaEncoder*> extra;
+	{
+		QMutexLocker lock(&mutex);
+		max_idle = qMax(0, count);
+		while (idle.size() > max_idle)
+			extra.append(idle.takeFirst());
+	}
+	qDeleteAll(extra);
+}
+
+int QLzmaEncoderPool::maxIdle() const
+{
+	QMutexLocker lock(&mutex);
+	return max_idle;
+}
+
+void QLzmaEncoderPool::clear()
+{
+	QList<QLzmaEncoder*> all;
+	{
+		QMutexLocker lock(&mutex);
+		all = idle;
+		idle.clear();
+	}
+	qDeleteAll(all);
+}
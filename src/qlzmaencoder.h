@@ -0,0 +1,99 @@
+/******************************************************************************
+	QLzmaEncoder: reusable LZMA encoder and a pool of them
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+#ifndef QLZMAENCODER_H
+#define QLZMAENCODER_H
+
+#include <qlist.h>
+#include <qmutex.h>
+#include "lzma/C/LzmaEnc.h"
+
+/*!
+	Keeps a CLzmaEncHandle between payloads. The match finder (hash, son, window), the range
+	encoder buffer and the probs are allocated by the first encode() and kept while the props do
+	not change their sizes; the next payloads only reset the state. The hash is not even cleared:
+	the new payload starts after the old positions (see MatchFinder_Init).
+	Writes raw LZMA streams, the container header is the caller's business (see QLzma).
+	An encoder is used by one thread at a time.
+*/
+class QLzmaEncoder
+{
+public:
+	QLzmaEncoder(int level = 7, unsigned int dictSize = 1 << 16, int threads = 1);
+	QLzmaEncoder(const CLzmaEncProps &props);
+	~QLzmaEncoder();
+
+	//threads: 1, or 2 for the match finder thread
+	void setProps(int level, unsigned int dictSize, int threads = 1);
+	//e.g. QLzmaMemoryPlan::props. writeEndMark is set by encode()
+	void setProps(const CLzmaEncProps &props);
+	const CLzmaEncProps& props() const;
+	int level() const;
+	unsigned int dictSize() const;
+	int threads() const;
+	bool isNull() const; //LzmaEnc_Create failed
+
+	//LZMA_PROPS_SIZE bytes: lc/lp/pb and dictSize
+	int writeProperties(Byte *props);
+	//memory to memory. destLen: in the buffer size, out the written size
+	int encode(Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen, bool writeEndMark, ICompressProgress *progress = 0);
+	//memory (e.g. a mapped file) to a stream
+	int encode(ISeqOutStream *out, const Byte *src, SizeT srcLen, bool writeEndMark, ICompressProgress *progress = 0);
+	int encode(ISeqOutStream *out, ISeqInStream *in, bool writeEndMark, ICompressProgress *progress = 0);
+	//of the last encode(). SZ_ERROR_UNSUPPORTED if the library does not count them (LZMA_ENC_STATS)
+	int stats(CLzmaEncStats *stats) const;
+
+private:
+	Q_DISABLE_COPY(QLzmaEncoder)
+	void setEndMark(bool writeEndMark);
+
+	CLzmaEncHandle enc;
+	CLzmaEncProps enc_props;
+};
+
+/*!
+	Idle encoders shared by all threads. acquire() prefers an encoder with the same props, so its
+	memory is reused as is. At most maxIdle() encoders are kept, the others are deleted by release().
+	QLzma takes its encoders from instance().
+*/
+class QLzmaEncoderPool
+{
+public:
+	static QLzmaEncoderPool* instance();
+
+	QLzmaEncoderPool(int maxIdle = 0); //0: QThread::idealThreadCount()
+	~QLzmaEncoderPool();
+	//0 if out of memory
+	QLzmaEncoder* acquire(int level, unsigned int dictSize, int threads = 1);
+	QLzmaEncoder* acquire(const CLzmaEncProps &props);
+	void release(QLzmaEncoder* encoder);
+	void setMaxIdle(int count);
+	int maxIdle() const;
+	//frees the idle encoders
+	void clear();
+
+private:
+	Q_DISABLE_COPY(QLzmaEncoderPool)
+	mutable QMutex mutex;
+	QList<QLzmaEncoder*> idle;
+	int max_idle;
+};
+
+#endif // QLZMAENCODER_H
@@ -0,0 +1,228 @@
+/******************************************************************************
+	QLzmaIndex: block index of LZMA2 streams for random access
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+#include "qlzmaindex.h"
+#include <string.h>
+#include <qiodevice.h>
+
+#define LZMA2_CONTROL_LZMA (1 << 7)
+#define LZMA2_CONTROL_COPY_RESET_DIC 1
+#define LZMA2_CONTROL_EOF 0
+
+#define INDEX_MAGIC "QLZI"
+#define INDEX_TAIL_SIZE 16 //unpacked size, n, magic
+
+static void putUInt64(QByteArray *a, UInt64 v)
+{
+	for (int i = 0; i < 8; i++, v >>= 8)
+		a->append((char)(Byte)v);
+}
+
+static UInt64 getUInt64(const Byte *p)
+{
+	UInt64 v = 0;
+	for (int i = 0; i < 8; i++)
+		v |= (UInt64)p[i] << (8 * i);
+	return v;
+}
+
+QLzmaIndex::QLzmaIndex()
+{
+	clear();
+}
+
+void QLzmaIndex::clear()
+{
+	blocks.clear();
+	pack_pos = unpack_pos = 0;
+	data_left = 0;
+	header_pos = header_size = 0;
+	finished = error = false;
+}
+
+void QLzmaIndex::update(const Byte *data, size_t size)
+{
+	while (size > 0 && !finished && !error) {
+		if (data_left > 0) {
+			size_t n = data_left < size ? (size_t)data_left : size;
+			data_left -= n;
+			data += n;
+			size -= n;
+			pack_pos += n;
+			continue;
+		}
+		Byte b = *data++;
+		--size;
+		header[header_pos++] = b;
+		if (header_pos == 1) {
+			if (b == LZMA2_CONTROL_EOF) {
+				finished = true;
+				++pack_pos;
+				break;
+			}
+			if (b & LZMA2_CONTROL_LZMA) {
+				header_size = ((b >> 5) & 3) >= 2 ? 6 : 5;
+			} else if (b <= 2) {
+				header_size = 3;
+			} else {
+				error = true;
+				break;
+			}
+			if (b == LZMA2_CONTROL_COPY_RESET_DIC || (b >> 5) == 7) {
+				QLzmaBlock block = { pack_pos, unpack_pos };
+				blocks.push_back(block);
+			}
+		}
+		++pack_pos;
+		if (header_pos < header_size)
+			continue;
+		UInt32 u = ((UInt32)header[1] << 8) | header[2];
+		if (header[0] & LZMA2_CONTROL_LZMA) {
+			u |= (UInt32)(header[0] & 0x1F) << 16;
+			data_left = (((UInt32)header[3] << 8) | header[4]) + 1;
+		} else {
+			data_left = u + 1;
+		}
+		unpack_pos += u + 1;
+		header_pos = 0;
+	}
+}
+
+bool QLzmaIndex::isFinished() const
+{
+	return finished;
+}
+
+UInt64 QLzmaIndex::packSize() const
+{
+	return pack_pos;
+}
+
+UInt64 QLzmaIndex::unpackSize() const
+{
+	return unpack_pos;
+}
+
+int QLzmaIndex::count() const
+{
+	return (int)blocks.size();
+}
+
+const QLzmaBlock& QLzmaIndex::at(int i) const
+{
+	return blocks[i];
+}
+
+int QLzmaIndex::find(UInt64 pos) const
+{
+	if (pos >= unpack_pos || blocks.empty())
+		return -1;
+	//the last block whose start <= pos
+	int lo = 0, hi = (int)blocks.size() - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (blocks[mid].unpackPos <= pos)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+QByteArray QLzmaIndex::trailer() const
+{
+	QByteArray a;
+	a.reserve((int)blocks.size() * 16 + INDEX_TAIL_SIZE);
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		putUInt64(&a, blocks[i].packPos);
+		putUInt64(&a, blocks[i].unpackPos);
+	}
+	putUInt64(&a, unpack_pos);
+	UInt32 n = (UInt32)blocks.size();
+	for (int i = 0; i < 4; i++, n >>= 8)
+		a.append((char)(Byte)n);
+	a.append(INDEX_MAGIC, 4);
+	return a;
+}
+
+bool QLzmaIndex::readTrailer(QIODevice *dev, qint64 streamPos)
+{
+	clear();
+	qint64 size = dev->size();
+	Byte tail[INDEX_TAIL_SIZE];
+	if (size - streamPos < INDEX_TAIL_SIZE || !dev->seek(size - INDEX_TAIL_SIZE)
+			|| dev->read((char*)tail, INDEX_TAIL_SIZE) != INDEX_TAIL_SIZE
+			|| memcmp(tail + 12, INDEX_MAGIC, 4) != 0)
+		return false;
+	UInt32 n = tail[8] | ((UInt32)tail[9] << 8) | ((UInt32)tail[10] << 16) | ((UInt32)tail[11] << 24);
+	qint64 indexPos = size - INDEX_TAIL_SIZE - (qint64)n * 16;
+	if (indexPos <= streamPos || !dev->seek(indexPos))
+		return false;
+	QByteArray a = dev->read((qint64)n * 16);
+	if (a.size() != (int)n * 16)
+		return false;
+	const Byte *p = (const Byte*)a.constData();
+	blocks.resize(n);
+	for (UInt32 i = 0; i < n; ++i, p += 16) {
+		blocks[i].packPos = getUInt64(p);
+		blocks[i].unpackPos = getUInt64(p + 8);
+	}
+	unpack_pos = getUInt64(tail);
+	pack_pos = indexPos - streamPos;
+	finished = true;
+	return true;
+}
+
+bool QLzmaIndex::scan(QIODevice *dev, qint64 streamPos)
+{
+	clear();
+	if (!dev->seek(streamPos))
+		return false;
+	while (!finished && !error) {
+		if (data_left > 0) {
+			//skip the chunk data, only the headers are read
+			pack_pos += data_left;
+			data_left = 0;
+			if (!dev->seek(streamPos + pack_pos))
+				return false;
+			continue;
+		}
+		char b;
+		if (!dev->getChar(&b))
+			return false;
+		update((const Byte*)&b, 1);
+	}
+	return finished;
+}
+
+
+QLzmaIndexOutStream::QLzmaIndexOutStream(ISeqOutStream *out, QLzmaIndex *index)
+	:out(out),index(index)
+{
+	Write = DoWrite;
+}
+
+//p is ISeqOutStream* !!
+size_t QLzmaIndexOutStream::DoWrite(void *p, const void *buf, size_t size)
+{
+	QLzmaIndexOutStream *s = static_cast<QLzmaIndexOutStream*>(static_cast<ISeqOutStream*>(p));
+	size_t written = s->out->Write(s->out, buf, size);
+	s->index->update((const Byte*)buf, written);
+	return written;
+}
@@ -0,0 +1,95 @@
+/******************************************************************************
+	QLzmaIndex: block index of LZMA2 streams for random access
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+#ifndef QLZMAINDEX_H
+#define QLZMAINDEX_H
+
+#include <vector>
+#include <qbytearray.h>
+#include "lzma/C/Types.h"
+
+class QIODevice;
+
+/*!
+	A block starts with an LZMA2 chunk that resets the dictionary, so the data can be decoded from
+	any block start. Offsets are relative to the first chunk (packed) and to the start of the data (unpacked).
+*/
+struct QLzmaBlock
+{
+	UInt64 packPos;
+	UInt64 unpackPos;
+};
+
+/*!
+	Collects the blocks by walking the LZMA2 chunk headers. The chunks are fed by update() while
+	they are written (QLzmaIndexOutStream), or read with seeks by scan().
+
+seek index trailer (optional, follows the LZMA2 end marker):
+  Offset      Size  Description
+	0        16*n   n blocks: packed offset, unpacked offset (little endian)
+	16*n       8    unpacked size (little endian)
+	16*n+8     4    n (little endian)
+	16*n+12    4    "QLZI"
+*/
+class QLzmaIndex
+{
+public:
+	QLzmaIndex();
+	void clear();
+
+	void update(const Byte *data, size_t size);
+	bool isFinished() const; //the end marker is reached
+	UInt64 packSize() const; //chunks and end marker
+	UInt64 unpackSize() const;
+
+	int count() const;
+	const QLzmaBlock& at(int i) const;
+	//the block which contains the unpacked offset pos, -1 if pos is out of range
+	int find(UInt64 pos) const;
+
+	QByteArray trailer() const;
+	//dev is the whole compressed file, streamPos is where the first chunk is
+	bool readTrailer(QIODevice *dev, qint64 streamPos);
+	bool scan(QIODevice *dev, qint64 streamPos);
+
+private:
+	std::vector<QLzmaBlock> blocks;
+	UInt64 pack_pos, unpack_pos;
+	UInt64 data_left; //data bytes of the current chunk
+	Byte header[6];
+	unsigned header_pos, header_size;
+	bool finished, error;
+};
+
+/*!
+	Passes the LZMA2 chunks written by Lzma2Enc_Encode to another ISeqOutStream and indexes them on the way
+*/
+class QLzmaIndexOutStream : public ISeqOutStream
+{
+public:
+	QLzmaIndexOutStream(ISeqOutStream *out, QLzmaIndex *index);
+
+private:
+	static size_t DoWrite(void *p, const void *buf, size_t size);
+
+	ISeqOutStream *out;
+	QLzmaIndex *index;
+};
+
+#endif // QLZMAINDEX_H
@@ -0,0 +1,132 @@
+/******************************************************************************
+	QLzmaMemoryPlan: encoder props which fit a memory budget
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+
+#include "qlzmaplan.h"
+#include "lzma/C/LzmaDec.h"
+
+#define kMinDictSize ((UInt32)1 << 12)
+//smaller dictionaries are tried only after the hash chain match finder
+#define kMinBtDictSize ((UInt32)1 << 20)
+//extractStream() reads the input by so much
+#define kDecoderInBufSize (1 << 18)
+
+QLzmaMemoryPlan::QLzmaMemoryPlan()
+	:format(QLzma::Lzma86),blockThreads(1),blockSize(0),encodeMemory(0),decodeMemory(0),fits(true)
+{
+	LzmaEncProps_Init(&props);
+	LzmaEncProps_Normalize(&props);
+}
+
+static void predict(QLzmaMemoryPlan *plan, qint64 inputSize)
+{
+	if (plan->format == QLzma::Lzma2) {
+		CLzma2EncProps p;
+		plan->apply(&p);
+		plan->encodeMemory = Lzma2Enc_GetMemUsage(&p);
+	} else {
+		plan->encodeMemory = LzmaEnc_GetMemUsage(&plan->props, 0, False);
+	}
+	//extractStream() allocates no more dictionary than the unpacked size
+	UInt32 dicBufSize = plan->props.dictSize;
+	if (inputSize >= 0 && (quint64)inputSize < dicBufSize)
+		dicBufSize = inputSize > 0 ? (UInt32)inputSize : 1;
+	plan->decodeMemory = LzmaDec_GetMemUsage(plan->props.lc, plan->props.lp, dicBufSize) + kDecoderInBufSize;
+}
+
+//one step down, false if there is nothing left to take
+static bool shrink(QLzmaMemoryPlan *plan)
+{
+	CLzmaEncProps &p = plan->props;
+	if (plan->blockThreads > 1) {
+		--plan->blockThreads;
+	} else if (p.numThreads > 1) {
+		p.numThreads = 1;
+	} else if (p.btMode == 1 && p.dictSize > kMinBtDictSize) {
+		p.dictSize = qMax(kMinBtDictSize, p.dictSize >> 1);
+	} else if (p.btMode == 1) {
+		p.btMode = 0;
+		p.numHashBytes = 4;
+		//what LzmaEncProps_Normalize() gives a hash chain
+		p.mc = (16 + (p.fb >> 1)) >> 1;
+	} else if (p.dictSize > kMinDictSize) {
+		p.dictSize = qMax(kMinDictSize, p.dictSize >> 1);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+QLzmaMemoryPlan QLzmaMemoryPlan::make(QLzma::Format format, int level, unsigned int dictSize, qint64 inputSize
+		, quint64 budget, int threads, size_t blockSize)
+{
+	QLzmaMemoryPlan plan;
+	plan.format = format;
+	LzmaEncProps_Init(&plan.props);
+	plan.props.level = level;
+	plan.props.dictSize = dictSize;
+	//LzmaEncProps_Normalize() reduces the dictionary to the input
+	if (inputSize >= 0)
+		plan.props.reduceSize = inputSize;
+	if (format == QLzma::Lzma2) {
+		//the threads go to the blocks, they scale better than the threaded match finder. QLzma does the same
+		plan.props.numThreads = 1;
+		CLzma2EncProps p;
+		Lzma2EncProps_Init(&p);
+		p.lzmaProps = plan.props;
+		p.numBlockThreads = qMax(1, threads);
+		p.blockSize = blockSize;
+		Lzma2EncProps_Normalize(&p);
+		plan.props = p.lzmaProps;
+		plan.blockThreads = p.numBlockThreads;
+		//no more threads than blocks
+		if (inputSize >= 0 && p.blockSize > 0) {
+			quint64 blocks = ((quint64)inputSize + p.blockSize - 1) / p.blockSize;
+			if ((quint64)plan.blockThreads > blocks)
+				plan.blockThreads = (int)qMax((quint64)1, blocks);
+		}
+		//auto block size follows the dictionary
+		plan.blockSize = blockSize;
+	} else {
+		plan.props.numThreads = threads > 1 ? 2 : 1;
+		LzmaEncProps_Normalize(&plan.props);
+	}
+	predict(&plan, inputSize);
+	while (budget > 0 && plan.encodeMemory > budget && shrink(&plan))
+		predict(&plan, inputSize);
+	plan.fits = budget == 0 || plan.encodeMemory <= budget;
+	return plan;
+}
+
+void QLzmaMemoryPlan::apply(CLzmaEncProps *p) const
+{
+	unsigned writeEndMark = p->writeEndMark;
+	*p = props;
+	p->writeEndMark = writeEndMark;
+}
+
+void QLzmaMemoryPlan::apply(CLzma2EncProps *p) const
+{
+	Lzma2EncProps_Init(p);
+	p->lzmaProps = props;
+	p->numBlockThreads = blockThreads;
+	p->numTotalThreads = blockThreads * props.numThreads;
+	p->blockSize = blockSize;
+}
@@ -0,0 +1,59 @@
+/******************************************************************************
+	QLzmaMemoryPlan: encoder props which fit a memory budget
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+#ifndef QLZMAPLAN_H
+#define QLZMAPLAN_H
+
+#include "qlzma.h"
+#include "lzma/C/LzmaEnc.h"
+#include "lzma/C/Lzma2Enc.h"
+
+/*!
+	Encoder props for a level, an input size and a memory budget, with the peak memory of the encoder
+	and of the decoder. The sizes are what LzmaEnc/Lzma2Enc and MatchFinder_Create allocate (see
+	LzmaEnc_GetMemUsage()), not the dictSize * 11.5 rule of thumb, so jobs can be packed on a machine.
+	To fit the budget make() takes away, in this order: the LZMA2 block threads, the match finder
+	thread, dictionary halvings down to 1 MB, the binary tree (bt4 -> hc4), dictionary halvings down to 4 KB.
+	The memory is predicted for streams. A mapped input file needs no window, a mapped output file no
+	decoder dictionary, so they take less.
+*/
+struct QLzmaMemoryPlan
+{
+	QLzmaMemoryPlan();
+	/*!
+		dictSize 0: the level's. inputSize < 0: unknown, else the dictionary is not bigger than the input.
+		budget 0: no limit. threads: LZMA2 block threads, for LZMA > 1 is the match finder thread.
+		blockSize: LZMA2, 0 is 4 * dictSize, at least 1 MB
+	*/
+	static QLzmaMemoryPlan make(QLzma::Format format, int level, unsigned int dictSize = 0, qint64 inputSize = -1
+			, quint64 budget = 0, int threads = 1, size_t blockSize = 0);
+	void apply(CLzmaEncProps *p) const;
+	void apply(CLzma2EncProps *p) const;
+
+	QLzma::Format format;
+	CLzmaEncProps props; //normalized. numThreads is 1 for LZMA2, the blocks are the threads
+	int blockThreads; //LZMA2 CLzma2EncProps::numBlockThreads, 1 for LZMA
+	size_t blockSize; //LZMA2, 0 for LZMA
+	quint64 encodeMemory;
+	quint64 decodeMemory;
+	bool fits; //encodeMemory <= budget. If not, props are the smallest ones
+};
+
+#endif // QLZMAPLAN_H
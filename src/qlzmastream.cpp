@@ -0,0 +1,98 @@
+/******************************************************************************
+	QLzmaStream: ISeqInStream/ISeqOutStream adapters over QIODevice
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+#include "qlzmastream.h"
+#include <qiodevice.h>
+
+QLzmaInStream::QLzmaInStream(QIODevice *dev)
+	:dev(dev),pos(0)
+{
+	Read = DoRead;
+}
+
+void QLzmaInStream::setDevice(QIODevice *d)
+{
+	dev = d;
+	pos = 0;
+}
+
+QIODevice* QLzmaInStream::device() const
+{
+	return dev;
+}
+
+UInt64 QLzmaInStream::processed() const
+{
+	return pos;
+}
+
+//p is ISeqInStream* !!
+SRes QLzmaInStream::DoRead(void *p, void *buf, size_t *size)
+{
+	QLzmaInStream *s = static_cast<QLzmaInStream*>(static_cast<ISeqInStream*>(p));
+	if (*size == 0)
+		return SZ_OK;
+	qint64 n = s->dev->read((char*)buf, *size);
+	if (n < 0) {
+		*size = 0;
+		return SZ_ERROR_READ;
+	}
+	*size = (size_t)n; //0: end of stream
+	s->pos += n;
+	return SZ_OK;
+}
+
+
+QLzmaOutStream::QLzmaOutStream(QIODevice *dev)
+	:dev(dev),pos(0)
+{
+	Write = DoWrite;
+}
+
+void QLzmaOutStream::setDevice(QIODevice *d)
+{
+	dev = d;
+	pos = 0;
+}
+
+QIODevice* QLzmaOutStream::device() const
+{
+	return dev;
+}
+
+UInt64 QLzmaOutStream::processed() const
+{
+	return pos;
+}
+
+//p is ISeqOutStream* !!
+size_t QLzmaOutStream::DoWrite(void *p, const void *buf, size_t size)
+{
+	QLzmaOutStream *s = static_cast<QLzmaOutStream*>(static_cast<ISeqOutStream*>(p));
+	const char *data = (const char*)buf;
+	size_t written = 0;
+	while (written < size) {
+		qint64 n = s->dev->write(data + written, size - written);
+		if (n <= 0)
+			break; //written < size means error
+		written += n;
+	}
+	s->pos += written;
+	return written;
+}
@@ -0,0 +1,63 @@
+/******************************************************************************
+	QLzmaStream: ISeqInStream/ISeqOutStream adapters over QIODevice
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+#ifndef QLZMASTREAM_H
+#define QLZMASTREAM_H
+
+#include "lzma/C/Types.h"
+
+class QIODevice;
+
+/*!
+	Lets LzmaEnc/LzmaDec pull from and push to a QIODevice (QFile, stdin...)
+	piece by piece, so the whole file never has to be in memory.
+	The lzma callbacks receive the ISeqInStream/ISeqOutStream pointer, which is
+	the address of these objects.
+*/
+class QLzmaInStream : public ISeqInStream
+{
+public:
+	QLzmaInStream(QIODevice *dev = 0);
+	void setDevice(QIODevice *dev);
+	QIODevice* device() const;
+	UInt64 processed() const; //bytes read so far
+
+private:
+	static SRes DoRead(void *p, void *buf, size_t *size);
+
+	QIODevice *dev;
+	UInt64 pos;
+};
+
+class QLzmaOutStream : public ISeqOutStream
+{
+public:
+	QLzmaOutStream(QIODevice *dev = 0);
+	void setDevice(QIODevice *dev);
+	QIODevice* device() const;
+	UInt64 processed() const; //bytes written so far
+
+private:
+	static size_t DoWrite(void *p, const void *buf, size_t size);
+
+	QIODevice *dev;
+	UInt64 pos;
+};
+
+#endif // QLZMASTREAM_H
@@ -0,0 +1,482 @@
+/******************************************************************************
+	QTarArchiver, QTarExtractor: tar streams of directories
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+#include "qtar.h"
+#include <string.h>
+#include <qdir.h>
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qdatetime.h>
+
+/*!
+ustar header (512 bytes), numbers are octal text:
+  Offset Size  Description
+	0    100   name
+	100    8   mode
+	108    8   uid
+	116    8   gid
+	124   12   size
+	136   12   mtime
+	148    8   checksum: sum of the header bytes, the checksum field taken as spaces
+	156    1   type: '0' file, '5' directory, 'x' pax header of the next entry, 'L' GNU long name
+	157  100   link name
+	257    6   "ustar\0"
+	263    2   "00"
+	265   32   user name
+	297   32   group name
+	329    8   device major
+	337    8   device minor
+	345  155   prefix of the name
+  The data follows, padded to 512 bytes. The archive ends with 2 zero blocks.
+*/
+#define TAR_BLOCK 512
+#define TAR_NAME 0
+#define TAR_MODE 100
+#define TAR_UID 108
+#define TAR_GID 116
+#define TAR_SIZE 124
+#define TAR_MTIME 136
+#define TAR_CHECKSUM 148
+#define TAR_TYPE 156
+#define TAR_MAGIC 257
+#define TAR_VERSION 263
+#define TAR_PREFIX 345
+
+static void writeOctal(char *field, int len, qint64 value)
+{
+	//len - 1 digits and a nul
+	field[len - 1] = 0;
+	for (int i = len - 2; i >= 0; --i, value >>= 3)
+		field[i] = '0' + (value & 7);
+}
+
+static qint64 readNumber(const char *field, int len)
+{
+	qint64 value = 0;
+	if ((unsigned char)field[0] & 0x80) { //GNU base-256
+		value = field[0] & 0x3f;
+		for (int i = 1; i < len; ++i)
+			value = (value << 8) | (unsigned char)field[i];
+		return value;
+	}
+	int i = 0;
+	while (i < len && field[i] == ' ')
+		++i;
+	for (; i < len && field[i] >= '0' && field[i] <= '7'; ++i)
+		value = (value << 3) | (field[i] - '0');
+	return value;
+}
+
+static unsigned checksum(const char *header)
+{
+	unsigned sum = 0;
+	for (int i = 0; i < TAR_BLOCK; ++i)
+		sum += (i >= TAR_CHECKSUM && i < TAR_CHECKSUM + 8) ? ' ' : (unsigned char)header[i];
+	return sum;
+}
+
+static int unixMode(QFile::Permissions p)
+{
+	int mode = 0;
+	if (p & QFile::ReadOwner) mode |= 0400;
+	if (p & QFile::WriteOwner) mode |= 0200;
+	if (p & QFile::ExeOwner) mode |= 0100;
+	if (p & QFile::ReadGroup) mode |= 040;
+	if (p & QFile::WriteGroup) mode |= 020;
+	if (p & QFile::ExeGroup) mode |= 010;
+	if (p & QFile::ReadOther) mode |= 04;
+	if (p & QFile::WriteOther) mode |= 02;
+	if (p & QFile::ExeOther) mode |= 01;
+	return mode;
+}
+
+static QFile::Permissions permissions(int mode)
+{
+	QFile::Permissions p = 0;
+	if (mode & 0400) p |= QFile::ReadOwner | QFile::ReadUser;
+	if (mode & 0200) p |= QFile::WriteOwner | QFile::WriteUser;
+	if (mode & 0100) p |= QFile::ExeOwner | QFile::ExeUser;
+	if (mode & 040) p |= QFile::ReadGroup;
+	if (mode & 020) p |= QFile::WriteGroup;
+	if (mode & 010) p |= QFile::ExeGroup;
+	if (mode & 04) p |= QFile::ReadOther;
+	if (mode & 02) p |= QFile::WriteOther;
+	if (mode & 01) p |= QFile::ExeOther;
+	return p;
+}
+
+//"len key=value\n", len counts itself
+static QByteArray paxRecord(const char *key, const QByteArray& value)
+{
+	QByteArray record = QByteArray(" ") + key + "=" + value + "\n";
+	int len = record.size();
+	len += QByteArray::number(len).size();
+	if (QByteArray::number(len).size() + record.size() != len) //one more digit
+		++len;
+	return QByteArray::number(len) + record;
+}
+
+static QByteArray tarHeader(const QByteArray& name, char type, qint64 size, int mode, qint64 mtime)
+{
+	QByteArray block(TAR_BLOCK, 0);
+	char *h = block.data();
+	memcpy(h + TAR_NAME, name.constData(), qMin(name.size(), 100));
+	writeOctal(h + TAR_MODE, 8, mode);
+	writeOctal(h + TAR_UID, 8, 0);
+	writeOctal(h + TAR_GID, 8, 0);
+	writeOctal(h + TAR_SIZE, 12, size);
+	writeOctal(h + TAR_MTIME, 12, mtime);
+	h[TAR_TYPE] = type;
+	memcpy(h + TAR_MAGIC, "ustar", 6);
+	memcpy(h + TAR_VERSION, "00", 2);
+	writeOctal(h + TAR_CHECKSUM, 7, checksum(h));
+	h[TAR_CHECKSUM + 7] = ' ';
+	return block;
+}
+
+static qint64 padding(qint64 size)
+{
+	return (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+}
+
+
+QTarArchiver::QTarArchiver(const QString &dir)
+	:it(0),root_done(false),ended(false),pending_pos(0),file(0),file_left(0),pad(0)
+{
+	QFileInfo fi(dir);
+	root = fi.absoluteFilePath();
+	root_name = fi.fileName();
+	if (root_name.isEmpty()) //"/" or "."
+		root_name = QDir(root).dirName();
+}
+
+QTarArchiver::~QTarArchiver()
+{
+	close();
+}
+
+bool QTarArchiver::isSequential() const
+{
+	return true;
+}
+
+void QTarArchiver::close()
+{
+	delete file;
+	file = 0;
+	delete it;
+	it = 0;
+	QIODevice::close();
+}
+
+//Puts the header(s) of the next entry into pending and opens the file. false if there is no more
+bool QTarArchiver::nextEntry()
+{
+	QFileInfo fi;
+	if (!root_done) {
+		root_done = true;
+		fi = QFileInfo(root);
+		it = new QDirIterator(root, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+	} else {
+		for (;;) {
+			if (!it->hasNext())
+				return false;
+			it->next();
+			fi = it->fileInfo();
+			if (fi.isDir() || fi.isFile())
+				break;
+		}
+	}
+	QString relative = root_name;
+	if (fi.absoluteFilePath() != root)
+		relative += "/" + QDir(root).relativeFilePath(fi.absoluteFilePath());
+	bool isDir = fi.isDir();
+	qint64 size = 0;
+	if (!isDir) {
+		file = new QFile(fi.absoluteFilePath());
+		if (!file->open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+			qWarning("tar: skip %s: %s", qPrintable(fi.absoluteFilePath()), qPrintable(file->errorString()));
+			delete file;
+			file = 0;
+			return nextEntry();
+		}
+		size = file->size();
+	} else {
+		relative += "/";
+	}
+	QByteArray name = QFile::encodeName(relative);
+	pending.clear();
+	pending_pos = 0;
+	QByteArray pax;
+	if (name.size() > 100)
+		pax += paxRecord("path", name);
+	if (size >= Q_INT64_C(077777777777)) //does not fit in 11 octal digits
+		pax += paxRecord("size", QByteArray::number(size));
+	if (!pax.isEmpty()) {
+		pending += tarHeader("././@PaxHeader", 'x', pax.size(), 0644, 0);
+		pending += pax;
+		pending += QByteArray(padding(pax.size()), 0);
+	}
+	pending += tarHeader(name, isDir ? '5' : '0', qMin(size, Q_INT64_C(077777777777)), unixMode(fi.permissions())
+						 , fi.lastModified().toTime_t());
+	file_left = size;
+	pad = padding(size);
+	return true;
+}
+
+qint64 QTarArchiver::readData(char *data, qint64 maxSize)
+{
+	qint64 n = 0;
+	while (n < maxSize) {
+		if (pending_pos < pending.size()) {
+			int len = (int)qMin((qint64)(pending.size() - pending_pos), maxSize - n);
+			memcpy(data + n, pending.constData() + pending_pos, len);
+			pending_pos += len;
+			n += len;
+		} else if (file && file_left > 0) {
+			qint64 len = file->read(data + n, qMin(file_left, maxSize - n));
+			if (len <= 0) { //the file is shorter than its header says
+				qWarning("tar: %s: %s", qPrintable(file->fileName()), qPrintable(file->errorString()));
+				len = qMin(file_left, maxSize - n);
+				memset(data + n, 0, len);
+			}
+			file_left -= len;
+			n += len;
+		} else if (file) {
+			delete file;
+			file = 0;
+			pending = QByteArray(pad, 0);
+			pending_pos = 0;
+		} else if (!ended && !nextEntry()) {
+			ended = true;
+			pending = QByteArray(2 * TAR_BLOCK, 0);
+			pending_pos = 0;
+		} else if (ended) {
+			break;
+		}
+	}
+	return n;
+}
+
+qint64 QTarArchiver::writeData(const char *, qint64)
+{
+	return -1;
+}
+
+
+QTarExtractor::QTarExtractor(const QString &dir)
+	:root(QDir(dir).absolutePath()),state(Header),header_pos(0),zero_blocks(0),next_size(-1),mode(0),file(0),left(0),pad(0)
+{
+	QDir().mkpath(root);
+}
+
+QTarExtractor::~QTarExtractor()
+{
+	close();
+}
+
+bool QTarExtractor::isSequential() const
+{
+	return true;
+}
+
+void QTarExtractor::close()
+{
+	finishFile();
+	QIODevice::close();
+}
+
+bool QTarExtractor::isFinished() const
+{
+	return state == End;
+}
+
+void QTarExtractor::finishFile()
+{
+	if (!file)
+		return;
+	file->close();
+	file->setPermissions(permissions(mode));
+	delete file;
+	file = 0;
+}
+
+void QTarExtractor::parseExtendedHeader()
+{
+	int pos = 0;
+	while (pos < extended.size()) {
+		int space = extended.indexOf(' ', pos);
+		if (space < 0)
+			break;
+		int len = extended.mid(pos, space - pos).toInt();
+		if (len <= 0 || pos + len > extended.size())
+			break;
+		QByteArray record = extended.mid(space + 1, pos + len - space - 2); //without '\n'
+		int eq = record.indexOf('=');
+		QByteArray key = record.left(eq), value = record.mid(eq + 1);
+		if (key == "path")
+			next_name = QFile::decodeName(value);
+		else if (key == "size")
+			next_size = value.toLongLong();
+		pos += len;
+	}
+}
+
+bool QTarExtractor::parseHeader()
+{
+	bool zero = true;
+	for (int i = 0; i < TAR_BLOCK && zero; ++i)
+		zero = header[i] == 0;
+	if (zero) {
+		if (++zero_blocks == 2)
+			state = End;
+		return true;
+	}
+	zero_blocks = 0;
+	if ((unsigned)readNumber(header + TAR_CHECKSUM, 8) != checksum(header)) {
+		setErrorString("tar: bad header checksum");
+		return false;
+	}
+	char type = header[TAR_TYPE];
+	qint64 size = readNumber(header + TAR_SIZE, 12);
+	if (size < 0) {
+		setErrorString("tar: bad size");
+		return false;
+	}
+	pad = padding(size);
+	left = size;
+	if (type == 'x' || type == 'L') {
+		if (size > (1 << 20)) {
+			setErrorString("tar: extended header is too big");
+			return false;
+		}
+		extended.clear();
+		state = type == 'x' ? ExtendedHeader : LongName;
+		return true;
+	}
+	if (type == 'g') { //global pax header, nothing we use
+		state = Skip;
+		return true;
+	}
+
+	if (next_size >= 0) {
+		size = next_size;
+		left = size;
+		pad = padding(size);
+	}
+	name = next_name;
+	next_name.clear();
+	next_size = -1;
+	if (name.isEmpty()) {
+		QByteArray n(header + TAR_NAME, qstrnlen(header + TAR_NAME, 100));
+		if (!memcmp(header + TAR_MAGIC, "ustar", 5) && header[TAR_PREFIX])
+			n = QByteArray(header + TAR_PREFIX, qstrnlen(header + TAR_PREFIX, 155)) + "/" + n;
+		name = QFile::decodeName(n);
+	}
+	mode = (int)readNumber(header + TAR_MODE, 8);
+	state = Skip;
+	if (name.startsWith('/') || name.split('/').contains("..") || name.contains('\\')) {
+		qWarning("tar: skip unsafe name %s", qPrintable(name));
+		return true;
+	}
+	QString path = root + "/" + name;
+	if (type == '5') {
+		QDir().mkpath(path);
+	} else if (type == '0' || type == '\0' || type == '7') {
+		QDir().mkpath(QFileInfo(path).absolutePath());
+		file = new QFile(path);
+		if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+			setErrorString(QString("tar: %1: %2").arg(path).arg(file->errorString()));
+			delete file;
+			file = 0;
+			return false;
+		}
+		state = FileData;
+	} else {
+		qWarning("tar: skip %s (type %c)", qPrintable(name), type);
+	}
+	return true;
+}
+
+qint64 QTarExtractor::writeData(const char *data, qint64 size)
+{
+	qint64 pos = 0;
+	while (pos < size) {
+		switch (state) {
+		case Header: {
+			int len = (int)qMin((qint64)(TAR_BLOCK - header_pos), size - pos);
+			memcpy(header + header_pos, data + pos, len);
+			header_pos += len;
+			pos += len;
+			if (header_pos == TAR_BLOCK) {
+				header_pos = 0;
+				if (!parseHeader())
+					return -1;
+				if (state != End && left == 0 && state != Header) {
+					finishFile();
+					state = pad > 0 ? Padding : Header;
+				}
+			}
+			break;
+		}
+		case ExtendedHeader:
+		case LongName:
+		case FileData:
+		case Skip: {
+			qint64 len = qMin(left, size - pos);
+			if (state == FileData) {
+				if (file->write(data + pos, len) != len) {
+					setErrorString(file->errorString());
+					return -1;
+				}
+			} else if (state != Skip) {
+				extended.append(data + pos, (int)len);
+			}
+			left -= len;
+			pos += len;
+			if (left == 0) {
+				if (state == ExtendedHeader)
+					parseExtendedHeader();
+				else if (state == LongName)
+					next_name = QFile::decodeName(QByteArray(extended.constData(), qstrnlen(extended.constData(), extended.size())));
+				finishFile();
+				state = pad > 0 ? Padding : Header;
+			}
+			break;
+		}
+		case Padding: {
+			qint64 len = qMin(pad, size - pos);
+			pad -= len;
+			pos += len;
+			if (pad == 0)
+				state = Header;
+			break;
+		}
+		case End:
+			return size; //the rest is the padding of the record
+		}
+	}
+	return size;
+}
+
+qint64 QTarExtractor::readData(char *, qint64)
+{
+	return -1;
+}
@@ -0,0 +1,103 @@
+/******************************************************************************
+	QTarArchiver, QTarExtractor: tar streams of directories
+	Copyright (C) 2011 Wang Bin <wbsecg1@gmail.com>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+
+#ifndef QTAR_H
+#define QTAR_H
+
+#include <qiodevice.h>
+#include <qbytearray.h>
+#include <qdiriterator.h>
+#include <qstring.h>
+
+class QFile;
+
+/*!
+	A sequential device which reads as a tar archive (ustar, with pax headers for long names
+	and files >= 8 GB) of a directory. The archive is built while it is read: only one file is
+	open at a time and nothing is written to disk, so it can be fed to the encoder directly.
+	The names start with the directory name, e.g. "dir/a.txt", like tar -c dir.
+	Regular files and directories are stored. A file which can not be opened is skipped.
+*/
+class QTarArchiver : public QIODevice
+{
+public:
+	QTarArchiver(const QString& dir);
+	~QTarArchiver();
+
+	bool isSequential() const;
+	void close();
+
+protected:
+	qint64 readData(char *data, qint64 maxSize);
+	qint64 writeData(const char *data, qint64 size);
+
+private:
+	bool nextEntry();
+
+	QString root, root_name;
+	QDirIterator *it;
+	bool root_done, ended;
+	QByteArray pending; //headers, padding and the end blocks
+	int pending_pos;
+	QFile *file;
+	qint64 file_left, pad;
+};
+
+/*!
+	A sequential device which unpacks the tar archive written to it into a directory, entry by
+	entry as the data comes in. Reads ustar, pax (path, size) and GNU long names.
+	Absolute names and names with ".." are skipped. Writing fails on a corrupted header.
+*/
+class QTarExtractor : public QIODevice
+{
+public:
+	QTarExtractor(const QString& dir);
+	~QTarExtractor();
+
+	bool isSequential() const;
+	void close();
+	//The end blocks are reached
+	bool isFinished() const;
+
+protected:
+	qint64 readData(char *data, qint64 maxSize);
+	qint64 writeData(const char *data, qint64 size);
+
+private:
+	enum State { Header, ExtendedHeader, LongName, FileData, Skip, Padding, End };
+	bool parseHeader();
+	void parseExtendedHeader();
+	void finishFile();
+
+	QString root;
+	State state;
+	char header[512];
+	int header_pos;
+	int zero_blocks;
+	QByteArray extended; //pax records or GNU long name being read
+	QString next_name; //from the pax header or the GNU long name
+	qint64 next_size; //-1: from the header
+	QString name;
+	int mode;
+	QFile *file;
+	qint64 left, pad;
+};
+
+#endif // QTAR_H
@@ -0,0 +1,17 @@
+TARGET = deckernel
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt app_bundle
+
+#single threaded, the encoder only makes the test streams
+DEFINES += _7ZIP_ST
+
+LZMA_C = ../../lzma/C
+INCLUDEPATH += $$LZMA_C
+
+SOURCES += main.c \
+    $$LZMA_C/LzmaDec.c \
+    $$LZMA_C/LzmaEnc.c \
+    $$LZMA_C/LzFind.c \
+    $$LZMA_C/Alloc.c \
+    $$LZMA_C/CpuArch.c
@@ -0,0 +1,199 @@
+/* deckernel -- LZMA_DEC_KERNEL_FAST must decode exactly as LZMA_DEC_KERNEL_REF:
+   the same output, result code, status and input consumed, also for corrupted streams.
+   Exit status: 0 ok, 1 failed */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LzmaDec.h"
+#include "LzmaEnc.h"
+
+#define kNumStreams 200
+#define kMaxSize ((size_t)1 << 20)
+
+static void *SzAlloc(void *p, size_t size) { p = p; return malloc(size); }
+static void SzFree(void *p, void *address) { p = p; free(address); }
+static ISzAlloc g_Alloc = { SzAlloc, SzFree };
+
+static UInt32 g_Seed = 1;
+
+static UInt32 Random(void)
+{
+  g_Seed = g_Seed * 1664525 + 1013904223;
+  return g_Seed >> 8;
+}
+
+/* runs of text, short and long repeats and noise, so every kind of symbol is decoded */
+static void Generate(Byte *buf, size_t size)
+{
+  size_t i = 0;
+  while (i < size)
+  {
+    size_t run = 1 + Random() % 300, j;
+    UInt32 kind = Random() % 4;
+    if (run > size - i)
+      run = size - i;
+    for (j = 0; j < run; j++, i++)
+    {
+      if (kind == 0)
+        buf[i] = (Byte)("the quick brown fox jumps over "[i % 31] ^ (Random() % 50 == 0));
+      else if (kind == 1 && i >= 24)
+        buf[i] = buf[i - 1 - (i / run) % 24];
+      else if (kind == 2 && i != 0)
+        buf[i] = buf[(i * 7) % i];
+      else
+        buf[i] = (Byte)Random();
+    }
+  }
+}
+
+typedef struct
+{
+  SRes res;
+  ELzmaStatus status;
+  size_t inProcessed;
+  size_t outSize;
+} CDecodeResult;
+
+/* Decodes src into out (outSize bytes at most) through a circular dictionary of dicBufSize.
+   chunked: the input and output are given to LzmaDec_DecodeToDic in random pieces,
+   which come from seed, so both kernels see the same pieces */
+static CDecodeResult Decode(const Byte *props, const Byte *src, size_t srcLen,
+    Byte *out, size_t outSize, size_t dicBufSize, int chunked, UInt32 seed)
+{
+  CDecodeResult r;
+  CLzmaDec dec;
+  UInt32 saved = g_Seed;
+
+  memset(&r, 0, sizeof(r));
+  g_Seed = seed;
+  LzmaDec_Construct(&dec);
+  r.res = LzmaDec_AllocateProbs(&dec, props, LZMA_PROPS_SIZE, &g_Alloc);
+  if (r.res != SZ_OK)
+    return r;
+  dec.dic = (Byte *)malloc(dicBufSize);
+  dec.dicBufSize = dicBufSize;
+  if (dec.dic == 0)
+  {
+    LzmaDec_FreeProbs(&dec, &g_Alloc);
+    r.res = SZ_ERROR_MEM;
+    return r;
+  }
+  LzmaDec_Init(&dec);
+  for (;;)
+  {
+    SizeT inSize = srcLen - r.inProcessed;
+    SizeT dicLimit = dicBufSize;
+    SizeT dicPos;
+    if (dec.dicPos == dec.dicBufSize)
+      dec.dicPos = 0;
+    if (chunked)
+    {
+      SizeT inChunk = 1 + Random() % 700;
+      SizeT dicChunk = dec.dicPos + 1 + Random() % 5000;
+      if (inSize > inChunk)
+        inSize = inChunk;
+      if (dicLimit > dicChunk)
+        dicLimit = dicChunk;
+    }
+    if (dicLimit - dec.dicPos > outSize - r.outSize)
+      dicLimit = dec.dicPos + (outSize - r.outSize);
+    dicPos = dec.dicPos;
+    r.res = LzmaDec_DecodeToDic(&dec, dicLimit, src + r.inProcessed, &inSize, LZMA_FINISH_ANY, &r.status);
+    memcpy(out + r.outSize, dec.dic + dicPos, dec.dicPos - dicPos);
+    r.outSize += dec.dicPos - dicPos;
+    r.inProcessed += inSize;
+    if (r.res != SZ_OK || r.status == LZMA_STATUS_FINISHED_WITH_MARK || r.outSize == outSize)
+      break;
+    if (inSize == 0 && dec.dicPos == dicPos && r.inProcessed == srcLen)
+      break;
+  }
+  free(dec.dic);
+  LzmaDec_FreeProbs(&dec, &g_Alloc);
+  g_Seed = saved;
+  return r;
+}
+
+static int TestStream(int index)
+{
+  CLzmaEncProps props;
+  Byte header[LZMA_PROPS_SIZE];
+  SizeT headerSize = LZMA_PROPS_SIZE;
+  size_t size = 1 + Random() % (index % 10 == 0 ? kMaxSize : kMaxSize / 8);
+  SizeT packSize = size + size / 2 + 1024;
+  Byte *src = (Byte *)malloc(size);
+  Byte *pack = (Byte *)malloc(packSize);
+  Byte *out1 = (Byte *)malloc(size);
+  Byte *out2 = (Byte *)malloc(size);
+  int corrupted = (index % 3 == 1);
+  int chunked = (index % 2 == 1);
+  int ok = 0;
+  size_t dicBufSize;
+  UInt32 seed;
+  CDecodeResult r1, r2;
+  SRes res;
+
+  if (src == 0 || pack == 0 || out1 == 0 || out2 == 0)
+    goto end;
+  Generate(src, size);
+  LzmaEncProps_Init(&props);
+  props.level = Random() % 10;
+  props.lc = Random() % 9;
+  props.lp = Random() % 5;
+  props.pb = Random() % 5;
+  /* small dictionaries wrap around the circular buffer in the decoder */
+  props.dictSize = (UInt32)1 << (12 + Random() % 8);
+  props.writeEndMark = Random() % 2;
+  props.numThreads = 1;
+  res = LzmaEncode(pack, &packSize, src, size, &props, header, &headerSize, props.writeEndMark, NULL, &g_Alloc, &g_Alloc);
+  if (res != SZ_OK)
+  {
+    printf("stream %d: encoder error %d\n", index, res);
+    goto end;
+  }
+  if (corrupted)
+  {
+    UInt32 i, numFlips = 1 + Random() % 8;
+    for (i = 0; i < numFlips; i++)
+      pack[Random() % packSize] ^= (Byte)(1 << (Random() % 8));
+  }
+  dicBufSize = (index % 4 < 2) ? props.dictSize : size;
+  if (dicBufSize < (1 << 12))
+    dicBufSize = (1 << 12);
+  seed = Random();
+
+  LzmaDec_SetKernel(LZMA_DEC_KERNEL_REF);
+  r1 = Decode(header, pack, packSize, out1, size, dicBufSize, chunked, seed);
+  LzmaDec_SetKernel(LZMA_DEC_KERNEL_FAST);
+  r2 = Decode(header, pack, packSize, out2, size, dicBufSize, chunked, seed);
+
+  ok = r1.res == r2.res && r1.status == r2.status && r1.inProcessed == r2.inProcessed
+      && r1.outSize == r2.outSize && memcmp(out1, out2, r1.outSize) == 0;
+  /* and the reference decodes the intact streams right */
+  if (ok && !corrupted)
+    ok = r1.res == SZ_OK && r1.outSize == size && memcmp(out1, src, size) == 0;
+  if (!ok)
+    printf("stream %d (lc %d lp %d pb %d, %lu bytes%s%s): ref %d/%d/%lu, fast %d/%d/%lu\n",
+        index, props.lc, props.lp, props.pb, (unsigned long)size,
+        chunked ? ", chunked" : "", corrupted ? ", corrupted" : "",
+        r1.res, (int)r1.status, (unsigned long)r1.outSize, r2.res, (int)r2.status, (unsigned long)r2.outSize);
+end:
+  free(src);
+  free(pack);
+  free(out1);
+  free(out2);
+  return ok;
+}
+
+int main(void)
+{
+  int i, numFailed = 0;
+  for (i = 0; i < kNumStreams; i++)
+    if (!TestStream(i))
+      numFailed++;
+  LzmaDec_SetKernel(LZMA_DEC_KERNEL_FAST);
+  printf("%d of %d streams decode the same with both kernels\n", kNumStreams - numFailed, kNumStreams);
+  printf(numFailed == 0 ? "ok\n" : "FAILED\n");
+  return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,22 @@
+TARGET = lzma2stats
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt app_bundle
+
+#the library is built without the counters by default, so its sources are compiled here with them
+DEFINES += LZMA_ENC_STATS
+
+LZMA_C = ../../lzma/C
+INCLUDEPATH += $$LZMA_C
+
+SOURCES += main.c \
+    $$LZMA_C/LzmaEnc.c \
+    $$LZMA_C/Lzma2Enc.c \
+    $$LZMA_C/LzFind.c \
+    $$LZMA_C/LzFindMt.c \
+    $$LZMA_C/MtCoder.c \
+    $$LZMA_C/Threads.c \
+    $$LZMA_C/Alloc.c \
+    $$LZMA_C/CpuArch.c
+
+unix: LIBS += -lpthread
@@ -0,0 +1,153 @@
+/* lzma2stats -- Lzma2Enc_GetStats must count the whole stream, whatever the number of block threads.
+   Exit status: 0 ok, 1 failed */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Lzma2Enc.h"
+#include "LzmaEnc.h"
+
+#define kInputSize ((size_t)8 << 20)
+#define kBlockSize ((size_t)1 << 20)
+
+static void *SzAlloc(void *p, size_t size) { p = p; return malloc(size); }
+static void SzFree(void *p, void *address) { p = p; free(address); }
+static ISzAlloc g_Alloc = { SzAlloc, SzFree };
+
+typedef struct
+{
+  ISeqInStream funcTable;
+  const Byte *data;
+  size_t rem;
+} CMemInStream;
+
+static SRes MemInStream_Read(void *pp, void *buf, size_t *size)
+{
+  CMemInStream *p = (CMemInStream *)pp;
+  if (*size > p->rem)
+    *size = p->rem;
+  memcpy(buf, p->data, *size);
+  p->data += *size;
+  p->rem -= *size;
+  return SZ_OK;
+}
+
+static size_t NullOutStream_Write(void *pp, const void *buf, size_t size)
+{
+  pp = pp;
+  buf = buf;
+  return size;
+}
+
+/* every byte is a literal, a short rep or inside a match */
+static UInt64 CountedBytes(const CLzmaEncStats *s)
+{
+  return s->numLiterals + s->numShortReps + s->matchLength;
+}
+
+static int TestLzma2(const Byte *src, int numBlockThreads)
+{
+  CLzma2EncHandle enc;
+  CLzma2EncProps props;
+  CMemInStream inStream;
+  ISeqOutStream outStream;
+  CLzmaEncStats stats;
+  SRes res;
+  int pass;
+
+  enc = Lzma2Enc_Create(&g_Alloc, &g_Alloc);
+  if (enc == 0)
+    return 0;
+  Lzma2EncProps_Init(&props);
+  props.lzmaProps.level = 1;
+  props.lzmaProps.numThreads = 1;
+  props.blockSize = kBlockSize;
+  props.numBlockThreads = numBlockThreads;
+  res = Lzma2Enc_SetProps(enc, &props);
+  outStream.Write = NullOutStream_Write;
+  inStream.funcTable.Read = MemInStream_Read;
+
+  /* twice: the second stream must not add to the first */
+  for (pass = 0; pass < 2 && res == SZ_OK; pass++)
+  {
+    inStream.data = src;
+    inStream.rem = kInputSize;
+    res = Lzma2Enc_Encode(enc, &outStream, &inStream.funcTable, NULL);
+    if (res == SZ_OK)
+      res = Lzma2Enc_GetStats(enc, &stats);
+  }
+  Lzma2Enc_Destroy(enc);
+  if (res != SZ_OK)
+  {
+    printf("lzma2, %d block threads: error %d\n", numBlockThreads, res);
+    return 0;
+  }
+  printf("lzma2, %d block threads: %llu of %lu bytes\n", numBlockThreads,
+      (unsigned long long)CountedBytes(&stats), (unsigned long)kInputSize);
+  return CountedBytes(&stats) == kInputSize;
+}
+
+static int TestLzma(const Byte *src)
+{
+  CLzmaEncHandle enc;
+  CLzmaEncProps props;
+  CLzmaEncStats stats;
+  Byte *dest;
+  SizeT destLen = 0;
+  SRes res;
+  int pass;
+
+  dest = (Byte *)malloc(kInputSize + kInputSize / 2);
+  enc = LzmaEnc_Create(&g_Alloc);
+  if (dest == 0 || enc == 0)
+  {
+    free(dest);
+    return 0;
+  }
+  LzmaEncProps_Init(&props);
+  props.level = 1;
+  res = LzmaEnc_SetProps(enc, &props);
+  for (pass = 0; pass < 2 && res == SZ_OK; pass++)
+  {
+    destLen = kInputSize + kInputSize / 2;
+    res = LzmaEnc_MemEncode(enc, dest, &destLen, src, kInputSize, 0, NULL, &g_Alloc, &g_Alloc);
+    if (res == SZ_OK)
+      res = LzmaEnc_GetStats(enc, &stats);
+  }
+  LzmaEnc_Destroy(enc, &g_Alloc, &g_Alloc);
+  free(dest);
+  if (res != SZ_OK)
+  {
+    printf("lzma: error %d\n", res);
+    return 0;
+  }
+  printf("lzma: %llu of %lu bytes\n", (unsigned long long)CountedBytes(&stats), (unsigned long)kInputSize);
+  return CountedBytes(&stats) == kInputSize;
+}
+
+int main(void)
+{
+  Byte *src;
+  size_t i;
+  UInt32 x = 1;
+  int ok = 1;
+
+  src = (Byte *)malloc(kInputSize);
+  if (src == 0)
+    return 1;
+  /* repeats with some noise, so there are literals, reps and matches */
+  for (i = 0; i < kInputSize; i++)
+  {
+    x = x * 1664525 + 1013904223;
+    src[i] = (i >= 1000 && (x >> 28) < 12) ? src[i - 1000 + ((x >> 20) & 3)] : (Byte)(x >> 24);
+  }
+
+  ok &= TestLzma(src);
+  ok &= TestLzma2(src, 1);
+  ok &= TestLzma2(src, 2);
+  ok &= TestLzma2(src, 4);
+  free(src);
+  printf(ok ? "ok\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}